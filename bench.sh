@@ -0,0 +1,78 @@
+#!/bin/sh
+# Benchmark sweep over the three versions (run by `make bench`): every
+# combination of image size, maximum iterations, c, chunk width, process
+# count and thread count below is rendered once. Each run appends a JSON
+# record (see -J); they are collected into $OUT/bench.json together with the
+# version they were taken at. Any setting can be given in the environment,
+# e.g. SIZES="1024 4096" RANKS="2 4 8" make bench
+set -e
+
+OUT=${OUT:-bench_out}
+SIZES=${SIZES:-"512 1024"}
+CHUNKS=${CHUNKS:-"16 32"}
+ITERS=${ITERS:-"500 2000"}
+CS=${CS:-"-0.4,0.6 0.285,0.01"}
+RANKS=${RANKS:-"1 2 4"}
+THREADS=${THREADS:-"1 2"}
+MPIRUN=${MPIRUN:-mpirun}
+MPICC=${MPICC:-mpicc}
+OPT=${OPT:-"-O2 -ffp-contract=off"}
+
+root=$(cd "$(dirname "$0")" && pwd)
+mkdir -p "$OUT"
+OUT=$(cd "$OUT" && pwd)
+runs="$OUT/runs.jsonl"
+rm -f "$runs"
+
+# Library and serial version built once, away from obj/ and bin/
+make -C "$root" ODIR="$OUT/obj" BDIR="$OUT/bin" OPT="$OPT" MPICC="$MPICC" > /dev/null
+lib=$(ls "$OUT"/obj/*.o | grep -v '/fracFun_')
+
+# Images are written into $OUT
+cd "$OUT"
+
+for size in $SIZES; do
+    for iter in $ITERS; do
+        for c in $CS; do
+            re=${c%,*}
+            im=${c#*,}
+            echo "$size x $size, $iter iterations, c = $re $im"
+
+            for t in $THREADS; do
+                "$OUT/bin/fracFun_DYNAMIC" -t "$t" -J "$runs" "$iter" "$re" "$im" "$size" "$size" > /dev/null
+            done
+
+            # The parallelised versions take all of these at compile time
+            for chunk in $CHUNKS; do
+                if [ $((size % chunk)) -ne 0 ]; then
+                    continue
+                fi
+
+                for d in MS CM; do
+                    $MPICC $OPT -DFULL_WIDTH="$size" -DCHUNK_WIDTH="$chunk" -DMAX_ITER="$iter" \
+                        -DC_RE="$re" -DC_IM="$im" -I "$root/include" \
+                        -o "$OUT/bin/$d" "$root/src/fracFun_$d.c" $lib -lm -pthread
+                done
+
+                for np in $RANKS; do
+                    for t in $THREADS; do
+                        $MPIRUN -np "$np" "$OUT/bin/MS" -t "$t" -J "$runs" > /dev/null
+                    done
+
+                    $MPIRUN -np "$np" "$OUT/bin/CM" -J "$runs" > /dev/null
+                done
+            done
+        done
+    done
+done
+
+version=$(git -C "$root" describe --always --dirty 2> /dev/null || echo unknown)
+
+{
+    printf '{"version": "%s", "date": "%s", "host": "%s", "cpus": %s, "runs": [\n' \
+        "$version" "$(date -u +%Y-%m-%dT%H:%M:%SZ)" "$(uname -n)" "$(getconf _NPROCESSORS_ONLN)"
+    sed '$!s/$/,/' "$runs"
+    printf ']}\n'
+} > "$OUT/bench.json"
+
+echo "$(wc -l < "$runs") runs written to $OUT/bench.json"
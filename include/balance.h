@@ -0,0 +1,26 @@
+#ifndef BALANCE_HEAD
+#define BALANCE_HEAD
+
+#include "mpi.h"
+#include "kernel.h"
+
+/**
+Estimates what each square cell 'cell' pixels wide of the first 'nrows' rows
+of cells of 'plane' costs to compute, from a coarse render of the same view
+at 'samples' * 'samples' pixels a cell: every sample counts its iterations
+plus one. The sample rows are shared out between the ranks of 'comm', which
+all have to call this together, and the costs are summed into 'cost' (row
+major) on every rank
+*/
+void balance_costs(const Plane* plane, int cell, int samples, int nrows, MPI_Comm comm, long long* cost);
+
+/**
+Splits the 'ncells' cells of 'cost' between 'nparts' ranks, setting each
+cell's 'owner': the most expensive cell goes first, each to the rank with the
+least cost so far (ties to the lower cell or rank). Only depends on 'cost',
+so every rank works out the same assignment. Returns the estimated
+imbalance, the most expensive rank's cost over the mean
+*/
+double balance_assign(const long long* cost, int ncells, int nparts, int* owner);
+
+#endif
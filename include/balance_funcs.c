@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include "balance.h"
+
+/**
+A cell and its cost, for sorting
+*/
+typedef struct BalanceCell
+{
+    long long cost;
+    int cell;
+} BalanceCell;
+
+/**
+Most expensive first, then in cell order
+*/
+static int balance_cell_cmp(const void* a, const void* b)
+{
+    const BalanceCell* p = (const BalanceCell*) a;
+    const BalanceCell* q = (const BalanceCell*) b;
+
+    if(p->cost != q->cost)
+        return p->cost > q->cost ? -1 : 1;
+
+    return p->cell - q->cell;
+}
+
+/**
+Cost estimation
+*/
+void balance_costs(const Plane* plane, int cell, int samples, int nrows, MPI_Comm comm, long long* cost)
+{
+    Plane coarse = *plane;
+    int per_row = plane->width / cell;
+    int nprocs, rank, y, x;
+    int* counts;
+
+    MPI_Comm_size(comm, &nprocs);
+    MPI_Comm_rank(comm, &rank);
+
+    /** The same view, at 'samples' pixels a cell */
+    coarse.width = per_row * samples;
+    coarse.height = plane->height / cell * samples;
+    counts = (int *)malloc(coarse.width * sizeof(int));
+
+    for(x = 0; x < nrows * per_row; x++)
+        cost[x] = 0;
+
+    /** Sample rows dealt out cyclically, as costly rows tend to be together */
+    for(y = rank; y < nrows * samples; y += nprocs) {
+        kernel_tile(&coarse, y, 0, 1, coarse.width, counts, coarse.width);
+
+        for(x = 0; x < coarse.width; x++)
+            cost[(y / samples) * per_row + x / samples] += counts[x] + 1;
+    }
+
+    /** Sums of integers, so every rank ends up with exactly the same costs */
+    MPI_Allreduce(MPI_IN_PLACE, cost, nrows * per_row, MPI_LONG_LONG, MPI_SUM, comm);
+
+    free(counts);
+}
+
+/**
+Greedy assignment
+*/
+double balance_assign(const long long* cost, int ncells, int nparts, int* owner)
+{
+    BalanceCell* cells = (BalanceCell *)malloc((ncells ? ncells : 1) * sizeof(BalanceCell));
+    long long* load = (long long *)calloc(nparts, sizeof(long long));
+    long long max = 0, total = 0;
+    int i, r, least;
+
+    for(i = 0; i < ncells; i++) {
+        cells[i].cost = cost[i];
+        cells[i].cell = i;
+    }
+
+    qsort(cells, ncells, sizeof(BalanceCell), balance_cell_cmp);
+
+    for(i = 0; i < ncells; i++) {
+        for(r = 1, least = 0; r < nparts; r++)
+            if(load[r] < load[least])
+                least = r;
+
+        owner[cells[i].cell] = least;
+        load[least] += cells[i].cost;
+    }
+
+    for(r = 0; r < nparts; r++) {
+        total += load[r];
+
+        if(load[r] > max)
+            max = load[r];
+    }
+
+    free(cells);
+    free(load);
+
+    return total > 0 ? (double) max * nparts / total : 1;
+}
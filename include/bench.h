@@ -0,0 +1,68 @@
+#ifndef BENCH_HEAD
+#define BENCH_HEAD
+
+#include "mpi.h"
+#include "cmplx.h"
+
+/**
+Wall-clock time spent computing by one worker thread, and the iterations its
+pixels stand for (the sum of their counts)
+*/
+typedef struct BenchWork
+{
+    double busy;
+    long long iterations;
+} BenchWork;
+
+/**
+One run of a driver, written out by bench_write(). Times are wall-clock
+seconds: 'wall' from the start of the computation until the image is
+written, 'compute' the computation, 'io' colouring and writing the image and
+'comm' the average time a computing rank spent in the computation without
+computing, i.e. waiting on messages. 'imbalance' is the longest time any
+worker thread spent computing over the average, 1 when perfectly balanced
+*/
+typedef struct BenchRecord
+{
+    const char* driver;
+    int width, height, frames, chunk, max_iterations;
+    Complex c;
+    int ranks, threads;
+    double wall, compute, io, comm;
+    long long iterations;
+    double imbalance;
+} BenchRecord;
+
+/**
+Monotonic wall-clock time in seconds
+*/
+double bench_now(void);
+
+/**
+Adds the time since 'since' (from bench_now()) and the counts of the 'h' *
+'w' block 'counts' ('stride' ints between rows) to 'work', if not NULL
+*/
+void bench_add(BenchWork* work, double since, const int* counts, int h, int w, int stride);
+
+/**
+Longest of the 'n' times in 'busy' over their average; 1 if they are all 0
+*/
+double bench_imbalance(const double* busy, int n);
+
+/**
+Appends 'record' to the file 'path' as one line of JSON, together with the
+pixel and iteration rates of the computation and the kernel's instruction
+set; returns 0, or -1 if it could not be written
+*/
+int bench_write(const char* path, const BenchRecord* record);
+
+/**
+Collectively gathers onto rank 0 of 'comm' each rank's time 'phase' in the
+computation and the 'work' of its 'nthreads' threads, the first 'workers' of
+which compute. Rank 0 fills in the iterations, communication and imbalance of
+'record' and writes it to 'path'; returns 0, or -1 if it could not be written
+*/
+int bench_gather(BenchRecord* record, const char* path, MPI_Comm comm,
+                 const BenchWork* work, int workers, int nthreads, double phase);
+
+#endif
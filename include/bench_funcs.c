@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "bench.h"
+#include "kernel.h"
+
+/**
+Clock reading
+*/
+double bench_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+Work accounting
+*/
+void bench_add(BenchWork* work, double since, const int* counts, int h, int w, int stride)
+{
+    long long sum = 0;
+    int i, j;
+
+    if(work == NULL)
+        return;
+
+    for(i = 0; i < h; i++)
+        for(j = 0; j < w; j++)
+            sum += counts[i * stride + j];
+
+    work->iterations += sum;
+    work->busy += bench_now() - since;
+}
+
+/**
+Imbalance of worker times
+*/
+double bench_imbalance(const double* busy, int n)
+{
+    double max = 0, total = 0;
+    int i;
+
+    for(i = 0; i < n; i++) {
+        total += busy[i];
+
+        if(busy[i] > max)
+            max = busy[i];
+    }
+
+    return total > 0 ? max * n / total : 1;
+}
+
+/**
+Record writing
+*/
+int bench_write(const char* path, const BenchRecord* record)
+{
+    FILE* file = fopen(path, "a");
+    double pixels = (double) record->width * record->height * record->frames;
+    double compute = record->compute > 0 ? record->compute : 1e-9;
+
+    if(file == NULL)
+        return -1;
+
+    fprintf(file, "{\"driver\": \"%s\", \"isa\": \"%s\", \"width\": %d, \"height\": %d, \"frames\": %d, "
+            "\"chunk\": %d, \"max_iterations\": %d, \"c_re\": %.16g, \"c_im\": %.16g, "
+            "\"ranks\": %d, \"threads\": %d, \"wall_s\": %.6f, \"compute_s\": %.6f, \"io_s\": %.6f, "
+            "\"comm_s\": %.6f, \"iterations\": %lld, \"mpixels_per_s\": %.3f, \"iterations_per_s\": %.6g, "
+            "\"imbalance\": %.4f}\n",
+            record->driver, kernel_isa_name(),
+            record->width, record->height, record->frames,
+            record->chunk, record->max_iterations, record->c.re, record->c.im,
+            record->ranks, record->threads,
+            record->wall, record->compute, record->io, record->comm,
+            record->iterations, pixels / compute / 1e6, record->iterations / compute,
+            record->imbalance);
+
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+/**
+Record gathering
+*/
+int bench_gather(BenchRecord* record, const char* path, MPI_Comm comm,
+                 const BenchWork* work, int workers, int nthreads, double phase)
+{
+    int nprocs, rank, i, r, n = 3 + nthreads, ranks = 0, nbusy = 0, result = 0;
+    double* mine = (double *)malloc(n * sizeof(double));
+    double *all = NULL, *busy = NULL, *row, mean;
+
+    MPI_Comm_size(comm, &nprocs);
+    MPI_Comm_rank(comm, &rank);
+
+    mine[0] = workers;
+    mine[1] = phase;
+    mine[2] = 0;
+
+    for(i = 0; i < nthreads; i++) {
+        mine[2] += work[i].iterations;
+        mine[3 + i] = work[i].busy;
+    }
+
+    if(rank == 0) {
+        all = (double *)malloc((size_t) nprocs * n * sizeof(double));
+        busy = (double *)malloc((size_t) nprocs * nthreads * sizeof(double));
+    }
+
+    MPI_Gather(mine, n, MPI_DOUBLE, all, n, MPI_DOUBLE, 0, comm);
+
+    if(rank == 0) {
+        record->iterations = 0;
+        record->comm = 0;
+
+        /** Only threads that compute count towards the balance; the rest of
+        a computing rank's time went on waiting for and sending pixels */
+        for(r = 0; r < nprocs; r++) {
+            row = all + (size_t) r * n;
+            record->iterations += (long long) row[2];
+
+            if(row[0] < 1)
+                continue;
+
+            for(i = 0, mean = 0; i < (int) row[0]; i++) {
+                busy[nbusy++] = row[3 + i];
+                mean += row[3 + i] / row[0];
+            }
+
+            record->comm += row[1] - mean;
+            ranks++;
+        }
+
+        record->comm = ranks > 0 ? record->comm / ranks : 0;
+        record->imbalance = bench_imbalance(busy, nbusy);
+        result = bench_write(path, record);
+
+        free(all);
+        free(busy);
+    }
+
+    free(mine);
+
+    return result;
+}
@@ -0,0 +1,81 @@
+#ifndef CACHE_HEAD
+#define CACHE_HEAD
+
+#include <stddef.h>
+#include "kernel.h"
+
+/**
+Bytes of tiles a cache directory holds before the least recently used ones
+are evicted; eviction goes down to three quarters of this
+*/
+#define CACHE_MAX_BYTES (256L << 20)
+
+/**
+Everything the counts of a tile depend on. A tile is identified by where it
+lies on the complex plane rather than in the image: its first pixel's
+starting z (in double-double, 'origin' + 'origin_lo', so the tiles of a deep
+zoom are told apart), the spacing of its pixels along rows and columns and
+its size, so the same tile of two renders of one region is found whichever
+image it came from. 'tolerance' is the periodicity tolerance (0 when off) and
+'subdivide' whether the tile was solved by subdivision
+*/
+typedef struct CacheKey
+{
+    Complex c;
+    Complex origin;
+    Complex origin_lo;
+    double spacing[2];
+    double tolerance;
+    int max_iterations;
+    int exponent;
+    int transpose;
+    int subdivide;
+    int h, w;
+} CacheKey;
+
+/**
+A directory of tiles of iteration counts, one file per tile named after the
+hash of its key, with an index of the tiles' sizes and when each was last
+used. Counts are stored as unsigned short where max_iterations allows,
+and a tile of one count as just that count. Safe to use from several threads
+*/
+typedef struct TileCache TileCache;
+
+/**
+Opens (creating if need be) the cache in directory 'dir', evicting tiles
+once it holds more than 'max_bytes'; returns NULL if the directory cannot be
+used. Tiles found in the directory but missing from the index (left by a
+run that did not close the cache) are taken in as the least recently used
+*/
+TileCache* cache_open(const char* dir, size_t max_bytes);
+
+/**
+Fills 'key' for the 'h' * 'w' tile of 'plane' at ('y', 'x'), computed with
+the current periodicity tolerance and by subdivision if 'subdivide'
+*/
+void cache_key(CacheKey* key, const Plane* plane, int y, int x, int h, int w, int subdivide);
+
+/**
+Looks the tile of 'key' up, writing its counts to 'out' with 'stride' ints
+between rows; returns 1 on a hit, 0 on a miss. A NULL cache never hits
+*/
+int cache_load(TileCache* cache, const CacheKey* key, int* out, int stride);
+
+/**
+Stores the tile of 'key' from 'counts' ('stride' ints between rows),
+evicting the least recently used tiles if the cache has grown too big;
+a NULL cache stores nothing
+*/
+void cache_store(TileCache* cache, const CacheKey* key, const int* counts, int stride);
+
+/**
+Number of hits and of lookups so far
+*/
+void cache_stats(TileCache* cache, long* hits, long* lookups);
+
+/**
+Writes the index back and frees the cache
+*/
+void cache_close(TileCache* cache);
+
+#endif
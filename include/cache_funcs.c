@@ -0,0 +1,460 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "ddouble.h"
+
+/**
+Start of every tile file; the digit is bumped whenever the layout changes
+*/
+#define CACHE_MAGIC "FRTILE2"
+
+/**
+Tile file header, followed by h * w counts of 'bytes' bytes each, or by just
+one if 'uniform'
+*/
+typedef struct CacheHeader
+{
+    char magic[8];
+    CacheKey key;
+    int bytes;
+    int uniform;
+} CacheHeader;
+
+/**
+Index entry: size of the tile's file and the tick it was last used at. A
+'hash' of 0 marks an empty slot, 'bytes' of 0 a tile whose file has gone
+*/
+typedef struct CacheEntry
+{
+    unsigned long long hash;
+    size_t bytes;
+    unsigned long used;
+} CacheEntry;
+
+/**
+The index is an open addressed hash table of 'cap' (a power of two) slots,
+'n' of them in use, covering 'total' bytes of files
+*/
+struct TileCache
+{
+    char* dir;
+    size_t max_bytes, total;
+    CacheEntry* table;
+    int cap, n;
+    unsigned long tick, serial;
+    long hits, lookups;
+    pthread_mutex_t lock;
+};
+
+/**
+FNV-1a hash of a key, never 0
+*/
+static unsigned long long cache_hash(const CacheKey* key)
+{
+    const unsigned char* p = (const unsigned char*) key;
+    unsigned long long hash = 14695981039346656037ULL;
+    size_t i;
+
+    for(i = 0; i < sizeof(CacheKey); i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash ? hash : 1;
+}
+
+/**
+Slot holding 'hash', or the empty slot it would go in
+*/
+static CacheEntry* cache_find(TileCache* cache, unsigned long long hash)
+{
+    int i = (int)(hash & (cache->cap - 1));
+
+    while(cache->table[i].hash && cache->table[i].hash != hash)
+        i = (i + 1) & (cache->cap - 1);
+
+    return &cache->table[i];
+}
+
+/**
+Adds or updates the entry for 'hash', growing the table to keep it at most
+half full
+*/
+static void cache_insert(TileCache* cache, unsigned long long hash, size_t bytes, unsigned long used)
+{
+    CacheEntry* old;
+    CacheEntry* e;
+    int i, cap;
+
+    if(2 * (cache->n + 1) > cache->cap) {
+        old = cache->table;
+        cap = cache->cap;
+        cache->cap *= 2;
+        cache->table = (CacheEntry *)calloc(cache->cap, sizeof(CacheEntry));
+
+        for(i = 0; i < cap; i++)
+            if(old[i].hash)
+                *cache_find(cache, old[i].hash) = old[i];
+
+        free(old);
+    }
+
+    e = cache_find(cache, hash);
+
+    if(e->hash)
+        cache->total -= e->bytes;
+    else
+        cache->n++;
+
+    e->hash = hash;
+    e->bytes = bytes;
+    e->used = used;
+    cache->total += bytes;
+}
+
+static void cache_path(const TileCache* cache, unsigned long long hash, char* path, size_t size)
+{
+    snprintf(path, size, "%s/%016llx.tile", cache->dir, hash);
+}
+
+static int cache_by_use(const void* a, const void* b)
+{
+    unsigned long ua = ((const CacheEntry*) a)->used, ub = ((const CacheEntry*) b)->used;
+
+    return ua < ub ? -1 : ua > ub;
+}
+
+/**
+Deletes the least recently used tiles until the cache is down to three
+quarters of its limit, and rebuilds the table from what is left; called with
+the lock held
+*/
+static void cache_evict(TileCache* cache)
+{
+    CacheEntry* live = (CacheEntry *)malloc(cache->n * sizeof(CacheEntry));
+    char path[PATH_MAX];
+    int i, n = 0, k;
+
+    for(i = 0; i < cache->cap; i++)
+        if(cache->table[i].hash && cache->table[i].bytes)
+            live[n++] = cache->table[i];
+
+    qsort(live, n, sizeof(CacheEntry), cache_by_use);
+
+    for(k = 0; k < n && cache->total > cache->max_bytes / 4 * 3; k++) {
+        cache_path(cache, live[k].hash, path, sizeof(path));
+        unlink(path);
+        cache->total -= live[k].bytes;
+    }
+
+    memset(cache->table, 0, cache->cap * sizeof(CacheEntry));
+    cache->n = 0;
+    cache->total = 0;
+
+    for(; k < n; k++)
+        cache_insert(cache, live[k].hash, live[k].bytes, live[k].used);
+
+    free(live);
+}
+
+/**
+Cache opening function
+*/
+TileCache* cache_open(const char* dir, size_t max_bytes)
+{
+    TileCache* cache;
+    char path[PATH_MAX];
+    unsigned long long hash;
+    unsigned long used;
+    size_t bytes;
+    FILE* index;
+    DIR* d;
+    struct dirent* ent;
+    struct stat st;
+    int end;
+
+    if(mkdir(dir, 0755) != 0 && errno != EEXIST)
+        return NULL;
+
+    if(stat(dir, &st) != 0 || !S_ISDIR(st.st_mode) || access(dir, R_OK | W_OK | X_OK) != 0)
+        return NULL;
+
+    cache = (TileCache *)malloc(sizeof(TileCache));
+    cache->dir = strdup(dir);
+    cache->max_bytes = max_bytes;
+    cache->total = 0;
+    cache->cap = 1024;
+    cache->n = 0;
+    cache->table = (CacheEntry *)calloc(cache->cap, sizeof(CacheEntry));
+    cache->tick = 1;
+    cache->serial = 0;
+    cache->hits = cache->lookups = 0;
+    pthread_mutex_init(&cache->lock, NULL);
+
+    /** Index lines: hash, bytes, last used */
+    snprintf(path, sizeof(path), "%s/index", dir);
+    index = fopen(path, "r");
+
+    if(index) {
+        while(fscanf(index, "%llx %zu %lu", &hash, &bytes, &used) == 3) {
+            if(hash == 0)
+                continue;
+
+            cache_insert(cache, hash, bytes, used);
+
+            if(used >= cache->tick)
+                cache->tick = used + 1;
+        }
+
+        fclose(index);
+    }
+
+    /** Tiles the index does not know of, oldest of all */
+    d = opendir(dir);
+
+    while(d && (ent = readdir(d))) {
+        if(sscanf(ent->d_name, "%16llx.tile%n", &hash, &end) != 1 || end != 21 ||
+           ent->d_name[end] != '\0' || hash == 0 || cache_find(cache, hash)->hash)
+            continue;
+
+        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+
+        if(stat(path, &st) == 0)
+            cache_insert(cache, hash, st.st_size, 0);
+    }
+
+    if(d)
+        closedir(d);
+
+    if(cache->total > cache->max_bytes)
+        cache_evict(cache);
+
+    return cache;
+}
+
+/**
+Key building function
+*/
+void cache_key(CacheKey* key, const Plane* plane, int y, int x, int h, int w, int subdivide)
+{
+    Complex d = plane_offset(plane, y, x);
+    DDouble re = dd_add(dd_make(plane->centre.re, plane->centre_lo.re), dd_make(d.re, 0));
+    DDouble im = dd_add(dd_make(plane->centre.im, plane->centre_lo.im), dd_make(d.im, 0));
+
+    /** No padding is left uninitialised to upset the hash */
+    memset(key, 0, sizeof(CacheKey));
+
+    key->c = plane->c;
+    key->origin.re = re.hi;
+    key->origin.im = im.hi;
+    key->origin_lo.re = re.lo;
+    key->origin_lo.im = im.lo;
+    key->spacing[0] = 2.0 * plane->scale / plane->width;
+    key->spacing[1] = 2.0 * plane->scale / plane->height;
+    key->tolerance = kernel_period_tolerance();
+    key->max_iterations = plane->max_iterations;
+    key->exponent = plane->exponent;
+    key->transpose = plane->transpose;
+    key->subdivide = subdivide;
+    key->h = h;
+    key->w = w;
+}
+
+/**
+Tile loading function
+*/
+int cache_load(TileCache* cache, const CacheKey* key, int* out, int stride)
+{
+    unsigned long long hash;
+    CacheEntry* e;
+    CacheHeader header;
+    char path[PATH_MAX];
+    unsigned char* data = NULL;
+    size_t n;
+    FILE* tile;
+    int present, ok = 0, i, j, v;
+
+    if(cache == NULL)
+        return 0;
+
+    hash = cache_hash(key);
+
+    pthread_mutex_lock(&cache->lock);
+    cache->lookups++;
+    e = cache_find(cache, hash);
+    present = e->hash && e->bytes;
+
+    if(present)
+        e->used = cache->tick++;
+
+    pthread_mutex_unlock(&cache->lock);
+
+    if(!present)
+        return 0;
+
+    cache_path(cache, hash, path, sizeof(path));
+    tile = fopen(path, "rb");
+
+    /** A colliding hash is told apart by the whole key in the header */
+    if(tile && fread(&header, sizeof(header), 1, tile) == 1 &&
+       memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+       memcmp(&header.key, key, sizeof(CacheKey)) == 0 &&
+       (header.bytes == 2 || header.bytes == 4)) {
+        n = header.uniform ? 1 : (size_t) key->h * key->w;
+        data = (unsigned char *)malloc(n * header.bytes);
+        ok = fread(data, header.bytes, n, tile) == n;
+    }
+
+    if(tile)
+        fclose(tile);
+
+    if(ok) {
+        for(i = 0; i < key->h; i++)
+            for(j = 0; j < key->w; j++) {
+                n = header.uniform ? 0 : (size_t) i * key->w + j;
+                v = header.bytes == 2 ? ((unsigned short*) data)[n] : ((int*) data)[n];
+                out[(size_t) i * stride + j] = v;
+            }
+    }
+
+    free(data);
+
+    pthread_mutex_lock(&cache->lock);
+
+    if(ok)
+        cache->hits++;
+    else {
+        /** Gone or unreadable, it will be stored again */
+        e = cache_find(cache, hash);
+
+        if(e->hash) {
+            cache->total -= e->bytes;
+            e->bytes = 0;
+        }
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+
+    return ok;
+}
+
+/**
+Tile storing function
+*/
+void cache_store(TileCache* cache, const CacheKey* key, const int* counts, int stride)
+{
+    unsigned long long hash;
+    CacheHeader header;
+    char path[PATH_MAX], part[PATH_MAX];
+    unsigned char* data;
+    size_t n, k;
+    FILE* tile;
+    int i, j, ok;
+
+    if(cache == NULL)
+        return;
+
+    hash = cache_hash(key);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.key = *key;
+    header.bytes = key->max_iterations <= USHRT_MAX ? 2 : 4;
+    header.uniform = 1;
+
+    for(i = 0; i < key->h && header.uniform; i++)
+        for(j = 0; j < key->w; j++)
+            if(counts[(size_t) i * stride + j] != counts[0]) {
+                header.uniform = 0;
+                break;
+            }
+
+    n = header.uniform ? 1 : (size_t) key->h * key->w;
+    data = (unsigned char *)malloc(n * header.bytes);
+
+    for(k = 0; k < n; k++) {
+        i = k / key->w;
+        j = k % key->w;
+
+        if(header.bytes == 2)
+            ((unsigned short*) data)[k] = (unsigned short) counts[(size_t) i * stride + j];
+        else
+            ((int*) data)[k] = counts[(size_t) i * stride + j];
+    }
+
+    /** Written under a name of its own and renamed into place, so a reader
+    never sees half a tile */
+    pthread_mutex_lock(&cache->lock);
+    snprintf(part, sizeof(part), "%s/%016llx.%ld.%lu.part", cache->dir, hash, (long) getpid(), cache->serial++);
+    pthread_mutex_unlock(&cache->lock);
+
+    cache_path(cache, hash, path, sizeof(path));
+    tile = fopen(part, "wb");
+    ok = tile && fwrite(&header, sizeof(header), 1, tile) == 1 && fwrite(data, header.bytes, n, tile) == n;
+
+    if(tile && fclose(tile) != 0)
+        ok = 0;
+
+    free(data);
+
+    if(!ok || rename(part, path) != 0) {
+        unlink(part);
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    cache_insert(cache, hash, sizeof(header) + n * header.bytes, cache->tick++);
+
+    if(cache->total > cache->max_bytes)
+        cache_evict(cache);
+
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+Statistics function
+*/
+void cache_stats(TileCache* cache, long* hits, long* lookups)
+{
+    pthread_mutex_lock(&cache->lock);
+    *hits = cache->hits;
+    *lookups = cache->lookups;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+Cache closing function
+*/
+void cache_close(TileCache* cache)
+{
+    char path[PATH_MAX], part[PATH_MAX];
+    FILE* index;
+    int i;
+
+    snprintf(path, sizeof(path), "%s/index", cache->dir);
+    snprintf(part, sizeof(part), "%s/index.%ld.part", cache->dir, (long) getpid());
+    index = fopen(part, "w");
+
+    if(index) {
+        for(i = 0; i < cache->cap; i++)
+            if(cache->table[i].hash && cache->table[i].bytes)
+                fprintf(index, "%016llx %zu %lu\n", cache->table[i].hash, cache->table[i].bytes, cache->table[i].used);
+
+        if(fclose(index) == 0)
+            rename(part, path);
+        else
+            unlink(part);
+    }
+
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->table);
+    free(cache->dir);
+    free(cache);
+}
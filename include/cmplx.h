@@ -10,18 +10,73 @@ typedef struct Complex
 } Complex;
 
 /**
-Complex abdolute function
+Complex magnitude function (squared, compared against radius^2)
 */
-double cmplx_magnitude(Complex c);
+static inline double cmplx_magnitude(Complex c)
+{
+	return (c.re * c.re) + (c.im * c.im);
+}
 
 /**
 Complex add function
 */
-Complex cmplx_add(Complex c_1, Complex c_2);
+static inline Complex cmplx_add(Complex c_1, Complex c_2)
+{
+	Complex retComp;
+
+	retComp.re = c_1.re + c_2.re;
+	retComp.im = c_1.im + c_2.im;
+
+	return(retComp);
+}
+
+/**
+Complex multiply function
+*/
+static inline Complex cmplx_mul(Complex c_1, Complex c_2)
+{
+	Complex retComp;
+
+	retComp.re = (c_1.re * c_2.re) - (c_1.im * c_2.im);
+	retComp.im = (c_1.re * c_2.im) + (c_1.im * c_2.re);
+
+	return(retComp);
+}
 
 /**
 Complex squaring function
 */
-Complex cmplx_squared(Complex c);
+static inline Complex cmplx_squared(Complex c)
+{
+	Complex retComp;
+
+	retComp.re = (c.re * c.re) - (c.im * c.im);
+	retComp.im = (c.im * c.re) * 2;
+
+	return(retComp);
+}
+
+/**
+Complex integer power function, by repeated squaring
+*/
+static inline Complex cmplx_powi(Complex c, int d)
+{
+	Complex retComp = {1, 0};
+
+	if(d == 2)
+		return cmplx_squared(c);
+
+	while(d > 0) {
+		if(d & 1)
+			retComp = cmplx_mul(retComp, c);
+
+		d >>= 1;
+
+		if(d)
+			c = cmplx_squared(c);
+	}
+
+	return(retComp);
+}
 
 #endif
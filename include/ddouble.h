@@ -0,0 +1,106 @@
+#ifndef DDOUBLE_HEAD
+#define DDOUBLE_HEAD
+
+/**
+Double-double: an unevaluated sum 'hi' + 'lo' of two doubles with |lo| at
+most half an ulp of 'hi', giving about 32 significant digits. The error-free
+transformations below rely on every operation being rounded on its own, so
+they must not be contracted into fused multiply-adds (-ffp-contract=off)
+*/
+typedef struct DDouble
+{
+    double hi, lo;
+} DDouble;
+
+static inline DDouble dd_make(double hi, double lo)
+{
+    DDouble r;
+
+    r.hi = hi;
+    r.lo = lo;
+
+    return r;
+}
+
+/**
+'a' + 'b' exactly, given |a| >= |b|
+*/
+static inline DDouble dd_quick_two_sum(double a, double b)
+{
+    double s = a + b;
+
+    return dd_make(s, b - (s - a));
+}
+
+/**
+'a' + 'b' exactly
+*/
+static inline DDouble dd_two_sum(double a, double b)
+{
+    double s = a + b, bb = s - a;
+
+    return dd_make(s, (a - (s - bb)) + (b - bb));
+}
+
+/**
+'a' * 'b' exactly, splitting each factor into halves of 26 bits (Dekker)
+*/
+static inline DDouble dd_two_prod(double a, double b)
+{
+    double p = a * b, t, a_hi, a_lo, b_hi, b_lo;
+
+    t = 134217729.0 * a;
+    a_hi = t - (t - a);
+    a_lo = a - a_hi;
+    t = 134217729.0 * b;
+    b_hi = t - (t - b);
+    b_lo = b - b_hi;
+
+    return dd_make(p, ((a_hi * b_hi - p) + a_hi * b_lo + a_lo * b_hi) + a_lo * b_lo);
+}
+
+static inline DDouble dd_add(DDouble a, DDouble b)
+{
+    DDouble s = dd_two_sum(a.hi, b.hi), t = dd_two_sum(a.lo, b.lo);
+
+    s = dd_quick_two_sum(s.hi, s.lo + t.hi);
+
+    return dd_quick_two_sum(s.hi, s.lo + t.lo);
+}
+
+static inline DDouble dd_neg(DDouble a)
+{
+    return dd_make(-a.hi, -a.lo);
+}
+
+static inline DDouble dd_sub(DDouble a, DDouble b)
+{
+    return dd_add(a, dd_neg(b));
+}
+
+static inline DDouble dd_mul(DDouble a, DDouble b)
+{
+    DDouble p = dd_two_prod(a.hi, b.hi);
+
+    return dd_quick_two_sum(p.hi, p.lo + (a.hi * b.lo + a.lo * b.hi));
+}
+
+static inline DDouble dd_div(DDouble a, DDouble b)
+{
+    double q1 = a.hi / b.hi, q2;
+    DDouble r = dd_sub(a, dd_mul(dd_make(q1, 0), b));
+
+    q2 = r.hi / b.hi;
+    r = dd_sub(r, dd_mul(dd_make(q2, 0), b));
+
+    return dd_add(dd_quick_two_sum(q1, q2), dd_make(r.hi / b.hi, 0));
+}
+
+/**
+Reads a decimal number ("-1.25", "3.0000000000000000000001e-7") from 's' to
+full double-double precision, with 'hi' the same double strtod() reads;
+'*end' is left after it, or at 's' if there is no number
+*/
+DDouble dd_parse(const char* s, char** end);
+
+#endif
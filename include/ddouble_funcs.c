@@ -0,0 +1,68 @@
+#include <stdlib.h>
+#include <ctype.h>
+#include <math.h>
+#include "ddouble.h"
+
+/**
+Decimal parsing function
+*/
+DDouble dd_parse(const char* s, char** end)
+{
+    DDouble m = dd_make(0, 0), p = dd_make(1, 0), ten = dd_make(10, 0);
+    const char* c = s;
+    double hi;
+    int neg = 0, digits = 0, exp = 0, e = 0, eneg = 0;
+
+    hi = strtod(s, end);
+
+    if(*end == s)
+        return m;
+
+    while(isspace((unsigned char) *c))
+        c++;
+
+    if(*c == '+' || *c == '-')
+        neg = *c++ == '-';
+
+    /** Mantissa as a whole number, the point shifting the exponent */
+    for(; isdigit((unsigned char) *c) || (*c == '.' && !digits); c++) {
+        if(*c == '.') {
+            digits = 1;
+            continue;
+        }
+
+        m = dd_add(dd_mul(m, ten), dd_make(*c - '0', 0));
+        exp -= digits;
+    }
+
+    if(*c == 'e' || *c == 'E') {
+        c++;
+
+        if(*c == '+' || *c == '-')
+            eneg = *c++ == '-';
+
+        while(isdigit((unsigned char) *c))
+            e = e * 10 + (*c++ - '0');
+
+        exp += eneg ? -e : e;
+    }
+
+    /** Anything strtod() reads that this does not (hex, inf) stays a double */
+    if(c != *end)
+        return dd_make(hi, 0);
+
+    for(e = exp < 0 ? -exp : exp; e > 0; e--)
+        p = dd_mul(p, ten);
+
+    m = exp < 0 ? dd_div(m, p) : dd_mul(m, p);
+
+    if(neg)
+        m = dd_neg(m);
+
+    /** Out of range as well for double-double */
+    if(!isfinite(m.hi) || (m.hi == 0 && hi != 0))
+        return dd_make(hi, 0);
+
+    /** Same leading double as strtod(), the rest in 'lo' */
+    return dd_make(hi, dd_sub(m, dd_make(hi, 0)).hi);
+}
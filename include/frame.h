@@ -0,0 +1,66 @@
+#ifndef FRAME_HEAD
+#define FRAME_HEAD
+
+#include <stddef.h>
+
+/**
+Rows start on cache line boundaries; buffers of at least a huge page are
+aligned to one and the kernel is asked to back them with huge pages
+*/
+#define FRAME_ALIGN 64
+#define FRAME_HUGE_PAGE (2 << 20)
+
+/**
+A 'width' * 'height' image in one contiguous, aligned, row-major buffer of
+'elem'-byte pixels, with 'pitch' pixels from the start of one row to the next.
+A tile of the frame is just frame_at() of its corner together with 'pitch'
+*/
+typedef struct Frame
+{
+    void* data;
+    int width, height;
+    int pitch;
+    size_t elem;
+} Frame;
+
+/**
+Pitch of a 'width' pixel row of 'elem'-byte pixels: 'width' rounded up until
+the row is a whole number of cache lines
+*/
+static inline int frame_pitch(int width, size_t elem)
+{
+    int step = FRAME_ALIGN;
+
+    while(step % 2 == 0 && (step / 2) * elem % FRAME_ALIGN == 0)
+        step /= 2;
+
+    return (width + step - 1) / step * step;
+}
+
+/**
+Address of pixel ('y', 'x')
+*/
+static inline void* frame_at(const Frame* frame, int y, int x)
+{
+    return (char*) frame->data + ((size_t) y * frame->pitch + x) * frame->elem;
+}
+
+/**
+Allocates 'frame' for a 'width' * 'height' image of 'elem'-byte pixels;
+returns 0, or -1 if the memory could not be allocated
+*/
+int frame_create(Frame* frame, int width, int height, size_t elem);
+
+/**
+Fills rows 'from' onwards with the 180 degree rotation of the rows above
+them, pixel ('y', 'x') taking the value of (plane_mirror(y), plane_mirror(x));
+pixels without a mirror are left as they are
+*/
+void frame_mirror(Frame* frame, int from);
+
+/**
+Frees the frame's buffer
+*/
+void frame_destroy(Frame* frame);
+
+#endif
@@ -0,0 +1,68 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "frame.h"
+#include "kernel.h"
+
+/**
+Frame allocating function
+*/
+int frame_create(Frame* frame, int width, int height, size_t elem)
+{
+    size_t bytes, align = FRAME_ALIGN;
+
+    frame->width = width;
+    frame->height = height;
+    frame->elem = elem;
+    frame->pitch = frame_pitch(width, elem);
+
+    bytes = (size_t) height * frame->pitch * elem;
+
+    if(bytes >= FRAME_HUGE_PAGE) {
+        align = FRAME_HUGE_PAGE;
+        /** Whole huge pages only */
+        bytes = (bytes + FRAME_HUGE_PAGE - 1) / FRAME_HUGE_PAGE * FRAME_HUGE_PAGE;
+    }
+
+    if(posix_memalign(&frame->data, align, bytes ? bytes : FRAME_ALIGN) != 0) {
+        frame->data = NULL;
+        return -1;
+    }
+
+#ifdef MADV_HUGEPAGE
+
+    /** Only a hint, falls back to normal pages */
+    if(align == FRAME_HUGE_PAGE)
+        madvise(frame->data, bytes, MADV_HUGEPAGE);
+
+#endif
+
+    return 0;
+}
+
+/**
+Frame mirroring function
+*/
+void frame_mirror(Frame* frame, int from)
+{
+    int y, x, mx;
+    char *dst, *src;
+
+    for(y = from; y < frame->height; y++) {
+        dst = (char*) frame_at(frame, y, 0);
+        src = (char*) frame_at(frame, plane_mirror(y, frame->height), 0);
+
+        for(x = 0; x < frame->width; x++)
+            if((mx = plane_mirror(x, frame->width)) >= 0)
+                memcpy(dst + x * frame->elem, src + mx * frame->elem, frame->elem);
+    }
+}
+
+/**
+Frame freeing function
+*/
+void frame_destroy(Frame* frame)
+{
+    free(frame->data);
+    frame->data = NULL;
+}
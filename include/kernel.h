@@ -0,0 +1,281 @@
+#ifndef KERNEL_HEAD
+#define KERNEL_HEAD
+
+#include "cmplx.h"
+
+struct Orbit;
+
+/**
+Maps the pixels of a 'width' * 'height' image onto the complex plane between
+'centre' - 'scale' and 'centre' + 'scale' on both axes (-1 to 1 for a centre
+of 0 and a scale of 1), X on the real axis and -Y on the imaginary axis as
+fracFun_CM/MS do; 'transpose' puts -Y on the real axis and X on the imaginary
+axis as fracFun_DYNAMIC does. 'exponent' is d in z = z^d + c. The centre is
+held in double-double, 'centre_lo' being the part below the precision of
+'centre' (0 unless the viewport was given that precisely). A deep zoom has
+'orbit' set, see zoom.h; it is NULL otherwise
+*/
+typedef struct Plane
+{
+    Complex c;
+    int max_iterations;
+    int exponent;
+    int width, height;
+    int transpose;
+    Complex centre;
+    Complex centre_lo;
+    double scale;
+    struct Orbit* orbit;
+} Plane;
+
+/**
+Pixel co-ordinate (mapped between -1 and 1) of position 'p' along an axis of
+'n' pixels
+*/
+static inline double plane_coord(int p, int n)
+{
+    return ((p - (n / 2)) / (double) n) * 2;
+}
+
+/**
+Offset of pixel ('y', 'x') from the centre
+*/
+static inline Complex plane_offset(const Plane* plane, int y, int x)
+{
+    Complex d;
+
+    if(plane->transpose) {
+        d.re = -(plane->scale * plane_coord(y, plane->height));
+        d.im = plane->scale * plane_coord(x, plane->width);
+    } else {
+        d.re = plane->scale * plane_coord(x, plane->width);
+        d.im = -(plane->scale * plane_coord(y, plane->height));
+    }
+
+    return d;
+}
+
+/**
+Starting value of z for pixel ('y', 'x'), to double precision
+*/
+static inline Complex plane_point(const Plane* plane, int y, int x)
+{
+    Complex z = plane_offset(plane, y, x);
+
+    z.re += plane->centre.re;
+    z.im += plane->centre.im;
+
+    return z;
+}
+
+/**
+Position mirroring 'p' through the centre of an axis of 'n' pixels, so that
+plane_coord() of one is exactly minus that of the other; -1 if that falls
+outside the axis (p = 0 when n is even)
+*/
+static inline int plane_mirror(int p, int n)
+{
+    int m = n % 2 ? n - 1 - p : n - p;
+
+    return m < n ? m : -1;
+}
+
+/**
+With an even exponent z and -z reach the same point after one iteration, so
+an image centred on 0 is symmetric under a 180 degree rotation: only the
+first plane_half() rows need computing, every row below mirrors one of them
+(apart from column 0 of an even width, which has no mirror)
+*/
+static inline int plane_symmetric(const Plane* plane)
+{
+    return plane->exponent % 2 == 0 && plane->centre.re == 0 && plane->centre.im == 0 &&
+           plane->centre_lo.re == 0 && plane->centre_lo.im == 0;
+}
+
+static inline int plane_half(int n)
+{
+    return n / 2 + 1;
+}
+
+/**
+Defines 'name' as a point kernel for z = z^D + c with escape radius RADIUS
+fixed at compile time; returns the number of iterations from 'z' before the
+point falls outside the circle. Calling it with a constant 'max_iterations'
+(MAX_ITER) lets the compiler fold that in as well
+*/
+#define KERNEL_POINT(name, D, RADIUS) \
+static inline int name(Complex z, Complex c, int max_iterations) \
+{ \
+    int itCount; \
+ \
+    for(itCount = 0; itCount < max_iterations; itCount++) { \
+        z = cmplx_add(cmplx_powi(z, (D)), c); \
+ \
+        if(cmplx_magnitude(z) > (RADIUS) * (RADIUS)) \
+            break; \
+    } \
+ \
+    return itCount; \
+}
+
+/**
+The common case: z = z^2 + c, escape radius 2
+*/
+KERNEL_POINT(kernel_point, 2, 2.0)
+
+/**
+kernel_point() with Brent-style orbit periodicity checking: the orbit is
+compared against a value saved at power-of-two intervals, and a return to
+within sqrt('tol2') of it means the point is caught in a bounded cycle, so it
+is reported as not escaping (max_iterations) straight away
+*/
+static inline int kernel_point_periodic(Complex z, Complex c, int max_iterations, double tol2)
+{
+    Complex saved = z, diff;
+    int itCount, steps = 0, check = 1;
+
+    for(itCount = 0; itCount < max_iterations; itCount++) {
+        z = cmplx_add(cmplx_squared(z), c);
+
+        if(cmplx_magnitude(z) > 4)
+            break;
+
+        diff.re = z.re - saved.re;
+        diff.im = z.im - saved.im;
+
+        if(cmplx_magnitude(diff) < tol2)
+            return max_iterations;
+
+        if(++steps == check) {
+            saved = z;
+            steps = 0;
+            check <<= 1;
+        }
+    }
+
+    return itCount;
+}
+
+/**
+Generic z = z^d + c with any escape radius, for exponents only known at run
+time
+*/
+static inline int kernel_point_d(Complex z, Complex c, int max_iterations, int d, double radius)
+{
+    int itCount;
+    double bound = radius * radius;
+
+    if(d == 2 && radius == 2.0)
+        return kernel_point(z, c, max_iterations);
+
+    for(itCount = 0; itCount < max_iterations; itCount++) {
+        z = cmplx_add(cmplx_powi(z, d), c);
+
+        if(cmplx_magnitude(z) > bound)
+            break;
+    }
+
+    return itCount;
+}
+
+/**
+Instruction sets the escape-time kernel can be dispatched to
+*/
+typedef enum KernelIsa
+{
+    KERNEL_ISA_AUTO = 0,
+    KERNEL_ISA_SCALAR,
+    KERNEL_ISA_SSE2,
+    KERNEL_ISA_AVX2,
+    KERNEL_ISA_AVX512
+} KernelIsa;
+
+/**
+Selects the instruction set used by kernel_row(); KERNEL_ISA_AUTO picks the
+widest one the CPU supports. Returns the instruction set actually selected
+*/
+KernelIsa kernel_select(KernelIsa isa);
+
+/**
+Name of the currently selected instruction set
+*/
+const char* kernel_isa_name(void);
+
+/**
+Periodicity tolerance for a render whose pixels are 'spacing' apart; small
+enough that no pixel is caught before it would have escaped
+*/
+#define KERNEL_PERIOD_TOL(spacing) ((spacing) * 1e-3)
+
+/**
+Enables periodicity checking (see kernel_point_periodic()) in kernel_row()
+with the given tolerance; 0 disables it
+*/
+void kernel_periodicity(double tolerance);
+
+/**
+Tolerance last given to kernel_periodicity(); 0 when checking is off
+*/
+double kernel_period_tolerance(void);
+
+/**
+Precision kernel_tile() iterates in. KERNEL_PRECISION_AUTO (the default,
+-DKERNEL_PRECISION_DEFAULT=... changes it) starts each tile in float on CPUs
+with vectors when the pixels are far enough apart for float to tell their
+starting points apart (see KERNEL_FLOAT_SPACING), and carries on in double
+once most of the points tried turn out to need it; KERNEL_PRECISION_FLOAT
+starts every tile in float and KERNEL_PRECISION_DOUBLE never uses it. A point
+keeps its float count only while a bound on how far its orbit may have
+drifted from the double one stays small and its escape is not too close to
+call; every other point is iterated again in double, so counts match a
+double render but for at most a few points per million
+*/
+typedef enum KernelPrecision
+{
+    KERNEL_PRECISION_AUTO = 0,
+    KERNEL_PRECISION_DOUBLE,
+    KERNEL_PRECISION_FLOAT
+} KernelPrecision;
+
+/**
+Pixel spacing, relative to the largest co-ordinate of the plane, below which
+KERNEL_PRECISION_AUTO stays in double: about 80 float steps between pixels
+*/
+#define KERNEL_FLOAT_SPACING 1e-5
+
+/**
+Sets the precision used by kernel_tile()
+*/
+void kernel_precision(KernelPrecision precision);
+
+/**
+Performs z = z^2 + c for each of the 'n' starting points (re[k], im[k]) and
+writes the number of iterations before the point fell outside the circle to
+'counts[k]'; several points are advanced per instruction and escaped lanes
+are masked off, giving the same counts as the scalar loop
+*/
+void kernel_row(const double* re, const double* im, int* counts, int n, Complex c, int max_iterations);
+
+/**
+kernel_row() for z = z^d + c with escape radius 'radius'; falls through to the
+vectorised kernel when d == 2 and radius == 2
+*/
+void kernel_row_d(const double* re, const double* im, int* counts, int n, Complex c, int max_iterations,
+                  int d, double radius);
+
+/**
+kernel_row_d() with radius 2 that also leaves the last z of each point inside
+the circle in ('re'[k], 'im'[k]), so points that have not escaped after
+'max_iterations' can later be carried on from where they stopped
+*/
+void kernel_row_z(double* re, double* im, int* counts, int n, Complex c, int max_iterations, int d);
+
+/**
+Computes the 'h' * 'w' rectangle of 'plane' at ('y', 'x') with kernel_row(),
+float first where kernel_precision() allows, or by perturbation (zoom_tile())
+for a deep zoom, writing counts to 'out' with 'stride' ints between rows; a
+single row or column is just a rectangle one pixel wide
+*/
+void kernel_tile(const Plane* plane, int y, int x, int h, int w, int* out, int stride);
+
+#endif
@@ -0,0 +1,836 @@
+#include <stdlib.h>
+#include <math.h>
+#include <immintrin.h>
+#include "kernel.h"
+#include "zoom.h"
+
+/** Pixels handed to kernel_row() at a time by kernel_tile() */
+#define KERNEL_BATCH 256
+
+/** Float lanes every float kernel runs at once; kernel_tile() pads to this */
+#define KERNEL_FLOAT_LANES 16
+
+/** Pixels of a tile tried in float before the rest of it follows */
+#define KERNEL_FLOAT_PROBE 64
+
+/** Bound on how far (squared) a float orbit may drift from the double one
+before the point is handed over to double, and the rounding error (squared)
+added to it each iteration */
+#define KERNEL_FLOAT_DRIFT 1e-6f
+#define KERNEL_FLOAT_ROUND 1e-13f
+
+/** Squared magnitudes this close to 4 are too close to call in float */
+#define KERNEL_FLOAT_MARGIN 0.01f
+
+#ifndef KERNEL_PRECISION_DEFAULT
+#define KERNEL_PRECISION_DEFAULT KERNEL_PRECISION_AUTO
+#endif
+
+typedef void (*KernelRowFn)(const double*, const double*, int*, int, Complex, int, double*, double*);
+typedef void (*KernelRowfFn)(const float*, const float*, int*, int, Complex, int);
+
+static void kernel_row_scalar(const double* re, const double* im, int* counts, int n, Complex c, int max_iterations,
+                              double* end_re, double* end_im);
+static void kernel_row_sse2(const double* re, const double* im, int* counts, int n, Complex c, int max_iterations,
+                            double* end_re, double* end_im);
+static void kernel_row_avx2(const double* re, const double* im, int* counts, int n, Complex c, int max_iterations,
+                            double* end_re, double* end_im);
+static void kernel_row_avx512(const double* re, const double* im, int* counts, int n, Complex c, int max_iterations,
+                              double* end_re, double* end_im);
+static void kernel_rowf_scalar(const float* re, const float* im, int* counts, int n, Complex c, int max_iterations);
+static void kernel_rowf_sse2(const float* re, const float* im, int* counts, int n, Complex c, int max_iterations);
+static void kernel_rowf_avx2(const float* re, const float* im, int* counts, int n, Complex c, int max_iterations);
+static void kernel_rowf_avx512(const float* re, const float* im, int* counts, int n, Complex c, int max_iterations);
+
+static KernelRowFn kernel_impl = 0;
+static KernelRowfFn kernel_implf = 0;
+static KernelIsa kernel_isa = KERNEL_ISA_SCALAR;
+/** Periodicity tolerance and its square, 0 when disabled */
+static double kernel_tol = 0, kernel_tol2 = 0;
+static KernelPrecision kernel_prec = KERNEL_PRECISION_DEFAULT;
+
+/**
+Instruction set selection
+*/
+KernelIsa kernel_select(KernelIsa isa)
+{
+    KernelRowFn impl;
+    KernelRowfFn implf;
+
+    __builtin_cpu_init();
+
+    if(isa == KERNEL_ISA_AUTO) {
+        if(__builtin_cpu_supports("avx512f"))
+            isa = KERNEL_ISA_AVX512;
+        else if(__builtin_cpu_supports("avx2"))
+            isa = KERNEL_ISA_AVX2;
+        else if(__builtin_cpu_supports("sse2"))
+            isa = KERNEL_ISA_SSE2;
+        else
+            isa = KERNEL_ISA_SCALAR;
+    }
+
+    /** Fall back to scalar if the requested set is not available */
+    if((isa == KERNEL_ISA_AVX512 && !__builtin_cpu_supports("avx512f")) ||
+       (isa == KERNEL_ISA_AVX2 && !__builtin_cpu_supports("avx2")) ||
+       (isa == KERNEL_ISA_SSE2 && !__builtin_cpu_supports("sse2")))
+        isa = KERNEL_ISA_SCALAR;
+
+    switch(isa) {
+    case KERNEL_ISA_AVX512:
+        impl = kernel_row_avx512;
+        implf = kernel_rowf_avx512;
+        break;
+    case KERNEL_ISA_AVX2:
+        impl = kernel_row_avx2;
+        implf = kernel_rowf_avx2;
+        break;
+    case KERNEL_ISA_SSE2:
+        impl = kernel_row_sse2;
+        implf = kernel_rowf_sse2;
+        break;
+    default:
+        impl = kernel_row_scalar;
+        implf = kernel_rowf_scalar;
+        break;
+    }
+
+    /** Threads may race to the first kernel_row() call, so publish atomically;
+    the float kernel goes first, it is only read after kernel_impl */
+    kernel_isa = isa;
+    kernel_implf = implf;
+    __atomic_store_n(&kernel_impl, impl, __ATOMIC_RELEASE);
+
+    return isa;
+}
+
+/**
+Instruction set name
+*/
+const char* kernel_isa_name(void)
+{
+    static const char* names[] = {"auto", "scalar", "sse2", "avx2", "avx512"};
+
+    if(kernel_impl == 0)
+        kernel_select(KERNEL_ISA_AUTO);
+
+    return names[kernel_isa];
+}
+
+/**
+Periodicity checking
+*/
+void kernel_periodicity(double tolerance)
+{
+    kernel_tol = tolerance;
+    kernel_tol2 = tolerance * tolerance;
+}
+
+/**
+Periodicity tolerance in use
+*/
+double kernel_period_tolerance(void)
+{
+    return kernel_tol;
+}
+
+/**
+Precision selection
+*/
+void kernel_precision(KernelPrecision precision)
+{
+    kernel_prec = precision;
+}
+
+/**
+Whether the tiles of 'plane' start out in float
+*/
+static int kernel_float_plane(const Plane* plane)
+{
+    double extent = fmax(fabs(plane->centre.re), fabs(plane->centre.im)) + plane->scale;
+    int n = plane->width > plane->height ? plane->width : plane->height;
+
+    /** Only the plain vector kernel has a float version */
+    if(kernel_prec == KERNEL_PRECISION_DOUBLE || plane->exponent != 2 || plane->orbit || kernel_tol2 > 0)
+        return 0;
+
+    if(kernel_prec == KERNEL_PRECISION_FLOAT)
+        return 1;
+
+    /** Without vectors float has no extra lanes to win */
+    return kernel_isa != KERNEL_ISA_SCALAR && 2.0 * plane->scale / n >= KERNEL_FLOAT_SPACING * extent;
+}
+
+/**
+Iterates z = z^d + c from '*z' as kernel_point_periodic() (or kernel_point_d()
+with radius 2 for d != 2) does, leaving '*z' at the last point inside the
+circle
+*/
+static int kernel_point_end(Complex* z, Complex c, int max_iterations, int d)
+{
+    Complex saved = *z, next, diff;
+    int itCount, steps = 0, check = 1;
+
+    for(itCount = 0; itCount < max_iterations; itCount++) {
+        next = cmplx_add(cmplx_powi(*z, d), c);
+
+        if(cmplx_magnitude(next) > 4)
+            break;
+
+        if(kernel_tol2 > 0 && d == 2) {
+            diff.re = next.re - saved.re;
+            diff.im = next.im - saved.im;
+
+            if(cmplx_magnitude(diff) < kernel_tol2)
+                return max_iterations;
+
+            if(++steps == check) {
+                saved = next;
+                steps = 0;
+                check <<= 1;
+            }
+        }
+
+        *z = next;
+    }
+
+    return itCount;
+}
+
+/**
+Row kernel, dispatched on first use
+*/
+void kernel_row(const double* re, const double* im, int* counts, int n, Complex c, int max_iterations)
+{
+    KernelRowFn impl = __atomic_load_n(&kernel_impl, __ATOMIC_ACQUIRE);
+
+    if(impl == 0) {
+        kernel_select(KERNEL_ISA_AUTO);
+        impl = kernel_impl;
+    }
+
+    impl(re, im, counts, n, c, max_iterations, NULL, NULL);
+}
+
+/**
+Row kernel keeping the last z of every point
+*/
+void kernel_row_z(double* re, double* im, int* counts, int n, Complex c, int max_iterations, int d)
+{
+    KernelRowFn impl = __atomic_load_n(&kernel_impl, __ATOMIC_ACQUIRE);
+    Complex z;
+    int k;
+
+    if(d != 2) {
+        for(k = 0; k < n; k++) {
+            z.re = re[k];
+            z.im = im[k];
+            counts[k] = kernel_point_end(&z, c, max_iterations, d);
+            re[k] = z.re;
+            im[k] = z.im;
+        }
+
+        return;
+    }
+
+    if(impl == 0) {
+        kernel_select(KERNEL_ISA_AUTO);
+        impl = kernel_impl;
+    }
+
+    impl(re, im, counts, n, c, max_iterations, re, im);
+}
+
+/**
+Rectangle kernel; pixels are batched across rows so that narrow rectangles and
+single columns still fill whole vectors
+*/
+void kernel_tile(const Plane* plane, int y, int x, int h, int w, int* out, int stride)
+{
+    double re_buf[KERNEL_BATCH], im_buf[KERNEL_BATCH];
+    float re_f[KERNEL_BATCH], im_f[KERNEL_BATCH];
+    int counts[KERNEL_BATCH], redo[KERNEL_BATCH], redo_counts[KERNEL_BATCH];
+    Complex z;
+    long k, m, len, total = (long) h * w;
+    int f, nf, nredo, single;
+
+    if(plane->orbit) {
+        zoom_tile(plane, y, x, h, w, out, stride);
+        return;
+    }
+
+    if(__atomic_load_n(&kernel_impl, __ATOMIC_ACQUIRE) == 0)
+        kernel_select(KERNEL_ISA_AUTO);
+
+    single = kernel_float_plane(plane);
+
+    for(k = 0; k < total; k += len) {
+        len = single && k == 0 ? KERNEL_FLOAT_PROBE : KERNEL_BATCH;
+        len = total - k < len ? total - k : len;
+
+        for(m = 0; m < len; m++) {
+            z = plane_point(plane, y + (k + m) / w, x + (k + m) % w);
+            re_buf[m] = z.re;
+            im_buf[m] = z.im;
+        }
+
+        if(!single) {
+            kernel_row_d(re_buf, im_buf, counts, len, plane->c, plane->max_iterations, plane->exponent, 2.0);
+        } else {
+            /** Float first, padded out to whole vectors by repeating the last point */
+            nf = (len + KERNEL_FLOAT_LANES - 1) / KERNEL_FLOAT_LANES * KERNEL_FLOAT_LANES;
+
+            for(f = 0; f < nf; f++) {
+                re_f[f] = (float) re_buf[f < len ? f : len - 1];
+                im_f[f] = (float) im_buf[f < len ? f : len - 1];
+            }
+
+            kernel_implf(re_f, im_f, counts, nf, plane->c, plane->max_iterations);
+
+            /** Then double for the points float could not settle */
+            for(m = 0, nredo = 0; m < len; m++)
+                if(counts[m] < 0) {
+                    re_buf[nredo] = re_buf[m];
+                    im_buf[nredo] = im_buf[m];
+                    redo[nredo++] = m;
+                }
+
+            kernel_row(re_buf, im_buf, redo_counts, nredo, plane->c, plane->max_iterations);
+
+            for(f = 0; f < nredo; f++)
+                counts[redo[f]] = redo_counts[f];
+
+            /** Mostly points near or inside the set: the rest of the tile goes
+            straight to double, unless float was asked for */
+            if(kernel_prec == KERNEL_PRECISION_AUTO && nredo * 2 > len)
+                single = 0;
+        }
+
+        for(m = 0; m < len; m++)
+            out[((k + m) / w) * stride + (k + m) % w] = counts[m];
+    }
+}
+
+/**
+Scalar fallback, also used for the tails of the vector kernels
+*/
+static void kernel_row_scalar(const double* re, const double* im, int* counts, int n, Complex c, int max_iterations,
+                              double* end_re, double* end_im)
+{
+    Complex z;
+    int k;
+
+    for(k = 0; k < n; k++) {
+        z.re = re[k];
+        z.im = im[k];
+
+        if(end_re) {
+            counts[k] = kernel_point_end(&z, c, max_iterations, 2);
+            end_re[k] = z.re;
+            end_im[k] = z.im;
+        } else
+            counts[k] = kernel_tol2 > 0 ? kernel_point_periodic(z, c, max_iterations, kernel_tol2)
+                                        : kernel_point(z, c, max_iterations);
+    }
+}
+
+/**
+Generic exponent and radius, scalar only
+*/
+void kernel_row_d(const double* re, const double* im, int* counts, int n, Complex c, int max_iterations,
+                  int d, double radius)
+{
+    Complex z;
+    int k;
+
+    if(d == 2 && radius == 2.0) {
+        kernel_row(re, im, counts, n, c, max_iterations);
+        return;
+    }
+
+    for(k = 0; k < n; k++) {
+        z.re = re[k];
+        z.im = im[k];
+        counts[k] = kernel_point_d(z, c, max_iterations, d, radius);
+    }
+}
+
+/**
+Two lanes; SSE2 has no blend so lanes are merged with and/andnot
+*/
+__attribute__((target("sse2")))
+static void kernel_row_sse2(const double* re, const double* im, int* counts, int n, Complex c, int max_iterations,
+                            double* end_re, double* end_im)
+{
+    const __m128d c_re = _mm_set1_pd(c.re), c_im = _mm_set1_pd(c.im);
+    const __m128d four = _mm_set1_pd(4.0), one = _mm_set1_pd(1.0);
+    const __m128d tol2 = _mm_set1_pd(kernel_tol2), max_it = _mm_set1_pd(max_iterations);
+    __m128d z_re, z_im, n_re, n_im, s_re, s_im, d_re, d_im, active, cycled, count;
+    int k, itCount, steps, check;
+
+    for(k = 0; k + 2 <= n; k += 2) {
+        z_re = _mm_loadu_pd(re + k);
+        z_im = _mm_loadu_pd(im + k);
+        s_re = z_re;
+        s_im = z_im;
+        steps = 0;
+        check = 1;
+        count = _mm_setzero_pd();
+        active = _mm_cmpeq_pd(count, count);
+
+        for(itCount = 0; itCount < max_iterations; itCount++) {
+            n_re = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(z_re, z_re), _mm_mul_pd(z_im, z_im)), c_re);
+            n_im = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(z_im, z_re), _mm_set1_pd(2.0)), c_im);
+
+            /** Retire lanes whose new magnitude is outside the circle */
+            active = _mm_andnot_pd(
+                         _mm_cmpgt_pd(_mm_add_pd(_mm_mul_pd(n_re, n_re), _mm_mul_pd(n_im, n_im)), four),
+                         active
+                     );
+
+            /** Retire lanes caught in a cycle as never escaping */
+            if(kernel_tol2 > 0) {
+                d_re = _mm_sub_pd(n_re, s_re);
+                d_im = _mm_sub_pd(n_im, s_im);
+                cycled = _mm_and_pd(
+                             _mm_cmplt_pd(_mm_add_pd(_mm_mul_pd(d_re, d_re), _mm_mul_pd(d_im, d_im)), tol2),
+                             active
+                         );
+                count = _mm_or_pd(_mm_and_pd(cycled, max_it), _mm_andnot_pd(cycled, count));
+                active = _mm_andnot_pd(cycled, active);
+
+                if(++steps == check) {
+                    s_re = n_re;
+                    s_im = n_im;
+                    steps = 0;
+                    check <<= 1;
+                }
+            }
+
+            if(_mm_movemask_pd(active) == 0)
+                break;
+
+            count = _mm_add_pd(count, _mm_and_pd(active, one));
+            z_re = _mm_or_pd(_mm_and_pd(active, n_re), _mm_andnot_pd(active, z_re));
+            z_im = _mm_or_pd(_mm_and_pd(active, n_im), _mm_andnot_pd(active, z_im));
+        }
+
+        _mm_storel_epi64((__m128i*)(counts + k), _mm_cvtpd_epi32(count));
+
+        if(end_re) {
+            _mm_storeu_pd(end_re + k, z_re);
+            _mm_storeu_pd(end_im + k, z_im);
+        }
+    }
+
+    kernel_row_scalar(re + k, im + k, counts + k, n - k, c, max_iterations,
+                      end_re ? end_re + k : NULL, end_im ? end_im + k : NULL);
+}
+
+/**
+Four lanes
+*/
+__attribute__((target("avx2")))
+static void kernel_row_avx2(const double* re, const double* im, int* counts, int n, Complex c, int max_iterations,
+                            double* end_re, double* end_im)
+{
+    const __m256d c_re = _mm256_set1_pd(c.re), c_im = _mm256_set1_pd(c.im);
+    const __m256d four = _mm256_set1_pd(4.0), one = _mm256_set1_pd(1.0), two = _mm256_set1_pd(2.0);
+    const __m256d tol2 = _mm256_set1_pd(kernel_tol2), max_it = _mm256_set1_pd(max_iterations);
+    __m256d z_re, z_im, n_re, n_im, s_re, s_im, d_re, d_im, active, cycled, count;
+    double re_pad[4], im_pad[4];
+    int count_pad[4];
+    const double *re_p, *im_p;
+    int* count_p;
+    int k, m, itCount, steps, check;
+
+    for(k = 0; k < n; k += 4) {
+        re_p = re + k;
+        im_p = im + k;
+        count_p = counts + k;
+
+        /** Pad a short tail by repeating its last point, so it still runs four wide */
+        if(n - k < 4) {
+            for(m = 0; m < 4; m++) {
+                re_pad[m] = re[m < n - k ? k + m : n - 1];
+                im_pad[m] = im[m < n - k ? k + m : n - 1];
+            }
+
+            re_p = re_pad;
+            im_p = im_pad;
+            count_p = count_pad;
+        }
+
+        z_re = _mm256_loadu_pd(re_p);
+        z_im = _mm256_loadu_pd(im_p);
+        s_re = z_re;
+        s_im = z_im;
+        steps = 0;
+        check = 1;
+        count = _mm256_setzero_pd();
+        active = _mm256_cmp_pd(count, count, _CMP_EQ_OQ);
+
+        for(itCount = 0; itCount < max_iterations; itCount++) {
+            n_re = _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(z_re, z_re), _mm256_mul_pd(z_im, z_im)), c_re);
+            n_im = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(z_im, z_re), two), c_im);
+
+            active = _mm256_andnot_pd(
+                         _mm256_cmp_pd(_mm256_add_pd(_mm256_mul_pd(n_re, n_re), _mm256_mul_pd(n_im, n_im)), four, _CMP_GT_OQ),
+                         active
+                     );
+
+            if(kernel_tol2 > 0) {
+                d_re = _mm256_sub_pd(n_re, s_re);
+                d_im = _mm256_sub_pd(n_im, s_im);
+                cycled = _mm256_and_pd(
+                             _mm256_cmp_pd(_mm256_add_pd(_mm256_mul_pd(d_re, d_re), _mm256_mul_pd(d_im, d_im)), tol2, _CMP_LT_OQ),
+                             active
+                         );
+                count = _mm256_blendv_pd(count, max_it, cycled);
+                active = _mm256_andnot_pd(cycled, active);
+
+                if(++steps == check) {
+                    s_re = n_re;
+                    s_im = n_im;
+                    steps = 0;
+                    check <<= 1;
+                }
+            }
+
+            if(_mm256_movemask_pd(active) == 0)
+                break;
+
+            count = _mm256_add_pd(count, _mm256_and_pd(active, one));
+            z_re = _mm256_blendv_pd(z_re, n_re, active);
+            z_im = _mm256_blendv_pd(z_im, n_im, active);
+        }
+
+        _mm_storeu_si128((__m128i*) count_p, _mm256_cvtpd_epi32(count));
+
+        if(count_p == count_pad)
+            for(m = 0; k + m < n; m++)
+                counts[k + m] = count_pad[m];
+
+        if(end_re && count_p == count_pad) {
+            _mm256_storeu_pd(re_pad, z_re);
+            _mm256_storeu_pd(im_pad, z_im);
+
+            for(m = 0; k + m < n; m++) {
+                end_re[k + m] = re_pad[m];
+                end_im[k + m] = im_pad[m];
+            }
+        } else if(end_re) {
+            _mm256_storeu_pd(end_re + k, z_re);
+            _mm256_storeu_pd(end_im + k, z_im);
+        }
+    }
+}
+
+/**
+Eight lanes with the active set held in a mask register
+*/
+__attribute__((target("avx512f")))
+static void kernel_row_avx512(const double* re, const double* im, int* counts, int n, Complex c, int max_iterations,
+                              double* end_re, double* end_im)
+{
+    const __m512d c_re = _mm512_set1_pd(c.re), c_im = _mm512_set1_pd(c.im);
+    const __m512d four = _mm512_set1_pd(4.0), one = _mm512_set1_pd(1.0), two = _mm512_set1_pd(2.0);
+    const __m512d tol2 = _mm512_set1_pd(kernel_tol2), max_it = _mm512_set1_pd(max_iterations);
+    __m512d z_re, z_im, n_re, n_im, s_re, s_im, d_re, d_im, count;
+    __mmask8 active, cycled, lanes;
+    int count_pad[8];
+    int k, m, itCount, steps, check;
+
+    for(k = 0; k < n; k += 8) {
+        /** A short tail runs with the missing lanes masked off from the start */
+        lanes = n - k < 8 ? (__mmask8)((1 << (n - k)) - 1) : 0xFF;
+        z_re = _mm512_maskz_loadu_pd(lanes, re + k);
+        z_im = _mm512_maskz_loadu_pd(lanes, im + k);
+        s_re = z_re;
+        s_im = z_im;
+        steps = 0;
+        check = 1;
+        count = _mm512_setzero_pd();
+        active = lanes;
+
+        for(itCount = 0; itCount < max_iterations; itCount++) {
+            n_re = _mm512_add_pd(_mm512_sub_pd(_mm512_mul_pd(z_re, z_re), _mm512_mul_pd(z_im, z_im)), c_re);
+            n_im = _mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(z_im, z_re), two), c_im);
+
+            active = _mm512_mask_cmp_pd_mask(
+                         active,
+                         _mm512_add_pd(_mm512_mul_pd(n_re, n_re), _mm512_mul_pd(n_im, n_im)),
+                         four,
+                         _CMP_NGT_UQ
+                     );
+
+            if(kernel_tol2 > 0) {
+                d_re = _mm512_sub_pd(n_re, s_re);
+                d_im = _mm512_sub_pd(n_im, s_im);
+                cycled = _mm512_mask_cmp_pd_mask(
+                             active,
+                             _mm512_add_pd(_mm512_mul_pd(d_re, d_re), _mm512_mul_pd(d_im, d_im)),
+                             tol2,
+                             _CMP_LT_OQ
+                         );
+                count = _mm512_mask_mov_pd(count, cycled, max_it);
+                active &= ~cycled;
+
+                if(++steps == check) {
+                    s_re = n_re;
+                    s_im = n_im;
+                    steps = 0;
+                    check <<= 1;
+                }
+            }
+
+            if(active == 0)
+                break;
+
+            count = _mm512_mask_add_pd(count, active, count, one);
+            z_re = _mm512_mask_mov_pd(z_re, active, n_re);
+            z_im = _mm512_mask_mov_pd(z_im, active, n_im);
+        }
+
+        if(lanes == 0xFF) {
+            _mm256_storeu_si256((__m256i*)(counts + k), _mm512_cvtpd_epi32(count));
+        } else {
+            _mm256_storeu_si256((__m256i*) count_pad, _mm512_cvtpd_epi32(count));
+
+            for(m = 0; k + m < n; m++)
+                counts[k + m] = count_pad[m];
+        }
+
+        if(end_re) {
+            _mm512_mask_storeu_pd(end_re + k, lanes, z_re);
+            _mm512_mask_storeu_pd(end_im + k, lanes, z_im);
+        }
+    }
+}
+
+/**
+Float kernels, for 'n' a multiple of KERNEL_FLOAT_LANES; the same loop as the
+double ones with twice the lanes. Alongside z each lane carries a bound 'e2'
+on how far (squared) its orbit may have drifted from the double one, growing
+with |dz'/dz|^2 = 4|z|^2 plus the rounding of each step, so it shrinks again
+on orbits drawn into a cycle. A point keeps its count only if that drift stays
+within KERNEL_FLOAT_DRIFT (checked every eight iterations and where the point
+stopped) and neither its last point inside the circle nor its first outside
+came within KERNEL_FLOAT_MARGIN of the edge; any other point gets -1, to be
+iterated again in double. One lane at a time
+*/
+static void kernel_rowf_scalar(const float* re, const float* im, int* counts, int n, Complex c, int max_iterations)
+{
+    const float c_re = c.re, c_im = c.im;
+    float z_re, z_im, n_re, n_im, rr, ii, mag, e2;
+    int k, itCount;
+
+    for(k = 0; k < n; k++) {
+        z_re = re[k];
+        z_im = im[k];
+        e2 = KERNEL_FLOAT_ROUND;
+
+        for(itCount = 0; itCount < max_iterations; itCount++) {
+            rr = z_re * z_re;
+            ii = z_im * z_im;
+            n_re = rr - ii + c_re;
+            n_im = z_im * z_re * 2 + c_im;
+            mag = n_re * n_re + n_im * n_im;
+
+            if(mag > 4)
+                break;
+
+            e2 = e2 * (rr + ii) * 4 + KERNEL_FLOAT_ROUND;
+
+            if((itCount & 7) == 7 && e2 > KERNEL_FLOAT_DRIFT)
+                break;
+
+            z_re = n_re;
+            z_im = n_im;
+        }
+
+        n_re = z_re * z_re - z_im * z_im + c_re;
+        n_im = z_im * z_re * 2 + c_im;
+        mag = n_re * n_re + n_im * n_im;
+
+        if(e2 > KERNEL_FLOAT_DRIFT || z_re * z_re + z_im * z_im > 4 - KERNEL_FLOAT_MARGIN ||
+           (mag > 4 - KERNEL_FLOAT_MARGIN && mag < 4 + KERNEL_FLOAT_MARGIN))
+            itCount = -1;
+
+        counts[k] = itCount;
+    }
+}
+
+/**
+Four float lanes
+*/
+__attribute__((target("sse2")))
+static void kernel_rowf_sse2(const float* re, const float* im, int* counts, int n, Complex c, int max_iterations)
+{
+    const __m128 c_re = _mm_set1_ps(c.re), c_im = _mm_set1_ps(c.im);
+    const __m128 four = _mm_set1_ps(4.0f), one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+    const __m128 round = _mm_set1_ps(KERNEL_FLOAT_ROUND), drift = _mm_set1_ps(KERNEL_FLOAT_DRIFT);
+    const __m128 near = _mm_set1_ps(4 - KERNEL_FLOAT_MARGIN), far = _mm_set1_ps(4 + KERNEL_FLOAT_MARGIN);
+    __m128 z_re, z_im, n_re, n_im, rr, ii, mag, e2, active, lost, count;
+    int k, itCount;
+
+    for(k = 0; k < n; k += 4) {
+        z_re = _mm_loadu_ps(re + k);
+        z_im = _mm_loadu_ps(im + k);
+        e2 = round;
+        count = _mm_setzero_ps();
+        lost = count;
+        active = _mm_cmpeq_ps(count, count);
+
+        for(itCount = 0; itCount < max_iterations; itCount++) {
+            rr = _mm_mul_ps(z_re, z_re);
+            ii = _mm_mul_ps(z_im, z_im);
+            n_re = _mm_add_ps(_mm_sub_ps(rr, ii), c_re);
+            n_im = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(z_im, z_re), two), c_im);
+            mag = _mm_add_ps(_mm_mul_ps(n_re, n_re), _mm_mul_ps(n_im, n_im));
+            active = _mm_andnot_ps(_mm_cmpgt_ps(mag, four), active);
+
+            /** Only lanes still iterating add to their drift */
+            rr = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(e2, _mm_add_ps(rr, ii)), four), round);
+            e2 = _mm_or_ps(_mm_and_ps(active, rr), _mm_andnot_ps(active, e2));
+
+            /** Retire lanes drifted too far to trust */
+            if((itCount & 7) == 7) {
+                lost = _mm_or_ps(lost, _mm_and_ps(_mm_cmpgt_ps(e2, drift), active));
+                active = _mm_andnot_ps(lost, active);
+            }
+
+            if(_mm_movemask_ps(active) == 0)
+                break;
+
+            count = _mm_add_ps(count, _mm_and_ps(active, one));
+            z_re = _mm_or_ps(_mm_and_ps(active, n_re), _mm_andnot_ps(active, z_re));
+            z_im = _mm_or_ps(_mm_and_ps(active, n_im), _mm_andnot_ps(active, z_im));
+        }
+
+        /** Drift where the point stopped, and how close its last point inside
+        the circle and its first outside came to the edge */
+        n_re = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(z_re, z_re), _mm_mul_ps(z_im, z_im)), c_re);
+        n_im = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(z_im, z_re), two), c_im);
+        mag = _mm_add_ps(_mm_mul_ps(n_re, n_re), _mm_mul_ps(n_im, n_im));
+        lost = _mm_or_ps(lost, _mm_or_ps(_mm_cmpgt_ps(e2, drift),
+                                         _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(z_re, z_re), _mm_mul_ps(z_im, z_im)), near)));
+        lost = _mm_or_ps(lost, _mm_and_ps(_mm_cmpgt_ps(mag, near), _mm_cmplt_ps(mag, far)));
+
+        count = _mm_or_ps(_mm_and_ps(lost, _mm_set1_ps(-1.0f)), _mm_andnot_ps(lost, count));
+        _mm_storeu_si128((__m128i*)(counts + k), _mm_cvtps_epi32(count));
+    }
+}
+
+/**
+Eight float lanes
+*/
+__attribute__((target("avx2")))
+static void kernel_rowf_avx2(const float* re, const float* im, int* counts, int n, Complex c, int max_iterations)
+{
+    const __m256 c_re = _mm256_set1_ps(c.re), c_im = _mm256_set1_ps(c.im);
+    const __m256 four = _mm256_set1_ps(4.0f), one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f);
+    const __m256 round = _mm256_set1_ps(KERNEL_FLOAT_ROUND), drift = _mm256_set1_ps(KERNEL_FLOAT_DRIFT);
+    const __m256 near = _mm256_set1_ps(4 - KERNEL_FLOAT_MARGIN), far = _mm256_set1_ps(4 + KERNEL_FLOAT_MARGIN);
+    __m256 z_re, z_im, n_re, n_im, rr, ii, mag, e2, active, lost, count;
+    int k, itCount;
+
+    for(k = 0; k < n; k += 8) {
+        z_re = _mm256_loadu_ps(re + k);
+        z_im = _mm256_loadu_ps(im + k);
+        e2 = round;
+        count = _mm256_setzero_ps();
+        lost = count;
+        active = _mm256_cmp_ps(count, count, _CMP_EQ_OQ);
+
+        for(itCount = 0; itCount < max_iterations; itCount++) {
+            rr = _mm256_mul_ps(z_re, z_re);
+            ii = _mm256_mul_ps(z_im, z_im);
+            n_re = _mm256_add_ps(_mm256_sub_ps(rr, ii), c_re);
+            n_im = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(z_im, z_re), two), c_im);
+            mag = _mm256_add_ps(_mm256_mul_ps(n_re, n_re), _mm256_mul_ps(n_im, n_im));
+            active = _mm256_andnot_ps(_mm256_cmp_ps(mag, four, _CMP_GT_OQ), active);
+            e2 = _mm256_blendv_ps(e2, _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(e2, _mm256_add_ps(rr, ii)), four), round), active);
+
+            if((itCount & 7) == 7) {
+                lost = _mm256_or_ps(lost, _mm256_and_ps(_mm256_cmp_ps(e2, drift, _CMP_GT_OQ), active));
+                active = _mm256_andnot_ps(lost, active);
+            }
+
+            if(_mm256_movemask_ps(active) == 0)
+                break;
+
+            count = _mm256_add_ps(count, _mm256_and_ps(active, one));
+            z_re = _mm256_blendv_ps(z_re, n_re, active);
+            z_im = _mm256_blendv_ps(z_im, n_im, active);
+        }
+
+        n_re = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(z_re, z_re), _mm256_mul_ps(z_im, z_im)), c_re);
+        n_im = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(z_im, z_re), two), c_im);
+        mag = _mm256_add_ps(_mm256_mul_ps(n_re, n_re), _mm256_mul_ps(n_im, n_im));
+        lost = _mm256_or_ps(lost, _mm256_or_ps(_mm256_cmp_ps(e2, drift, _CMP_GT_OQ),
+                                               _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(z_re, z_re), _mm256_mul_ps(z_im, z_im)), near, _CMP_GT_OQ)));
+        lost = _mm256_or_ps(lost, _mm256_and_ps(_mm256_cmp_ps(mag, near, _CMP_GT_OQ), _mm256_cmp_ps(mag, far, _CMP_LT_OQ)));
+
+        count = _mm256_blendv_ps(count, _mm256_set1_ps(-1.0f), lost);
+        _mm256_storeu_si256((__m256i*)(counts + k), _mm256_cvtps_epi32(count));
+    }
+}
+
+/**
+Sixteen float lanes
+*/
+__attribute__((target("avx512f")))
+static void kernel_rowf_avx512(const float* re, const float* im, int* counts, int n, Complex c, int max_iterations)
+{
+    const __m512 c_re = _mm512_set1_ps(c.re), c_im = _mm512_set1_ps(c.im);
+    const __m512 four = _mm512_set1_ps(4.0f), one = _mm512_set1_ps(1.0f), two = _mm512_set1_ps(2.0f);
+    const __m512 round = _mm512_set1_ps(KERNEL_FLOAT_ROUND), drift = _mm512_set1_ps(KERNEL_FLOAT_DRIFT);
+    const __m512 near = _mm512_set1_ps(4 - KERNEL_FLOAT_MARGIN), far = _mm512_set1_ps(4 + KERNEL_FLOAT_MARGIN);
+    __m512 z_re, z_im, n_re, n_im, rr, ii, mag, e2, count;
+    __mmask16 active, lost;
+    int k, itCount;
+
+    for(k = 0; k < n; k += 16) {
+        z_re = _mm512_loadu_ps(re + k);
+        z_im = _mm512_loadu_ps(im + k);
+        e2 = round;
+        count = _mm512_setzero_ps();
+        lost = 0;
+        active = 0xFFFF;
+
+        for(itCount = 0; itCount < max_iterations; itCount++) {
+            rr = _mm512_mul_ps(z_re, z_re);
+            ii = _mm512_mul_ps(z_im, z_im);
+            n_re = _mm512_add_ps(_mm512_sub_ps(rr, ii), c_re);
+            n_im = _mm512_add_ps(_mm512_mul_ps(_mm512_mul_ps(z_im, z_re), two), c_im);
+            mag = _mm512_add_ps(_mm512_mul_ps(n_re, n_re), _mm512_mul_ps(n_im, n_im));
+            active = _mm512_mask_cmp_ps_mask(active, mag, four, _CMP_NGT_UQ);
+            e2 = _mm512_mask_add_ps(e2, active, _mm512_mul_ps(_mm512_mul_ps(e2, _mm512_add_ps(rr, ii)), four), round);
+
+            if((itCount & 7) == 7) {
+                lost |= _mm512_mask_cmp_ps_mask(active, e2, drift, _CMP_GT_OQ);
+                active &= ~lost;
+            }
+
+            if(active == 0)
+                break;
+
+            count = _mm512_mask_add_ps(count, active, count, one);
+            z_re = _mm512_mask_mov_ps(z_re, active, n_re);
+            z_im = _mm512_mask_mov_ps(z_im, active, n_im);
+        }
+
+        /** Drift where the point stopped, and how close its last point inside
+        the circle and its first outside came to the edge */
+        n_re = _mm512_add_ps(_mm512_sub_ps(_mm512_mul_ps(z_re, z_re), _mm512_mul_ps(z_im, z_im)), c_re);
+        n_im = _mm512_add_ps(_mm512_mul_ps(_mm512_mul_ps(z_im, z_re), two), c_im);
+        mag = _mm512_add_ps(_mm512_mul_ps(n_re, n_re), _mm512_mul_ps(n_im, n_im));
+        lost |= _mm512_cmp_ps_mask(e2, drift, _CMP_GT_OQ) |
+                _mm512_cmp_ps_mask(_mm512_add_ps(_mm512_mul_ps(z_re, z_re), _mm512_mul_ps(z_im, z_im)), near, _CMP_GT_OQ) |
+                (_mm512_cmp_ps_mask(mag, near, _CMP_GT_OQ) & _mm512_cmp_ps_mask(mag, far, _CMP_LT_OQ));
+
+        count = _mm512_mask_mov_ps(count, lost, _mm512_set1_ps(-1.0f));
+        _mm512_storeu_si512((void*)(counts + k), _mm512_cvtps_epi32(count));
+    }
+}
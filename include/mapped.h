@@ -0,0 +1,47 @@
+#ifndef MAPPED_HEAD
+#define MAPPED_HEAD
+
+#include <stddef.h>
+#include <sys/mman.h>
+
+/**
+A P6 image file sized up front and mapped into memory, so pixels can be
+coloured straight into their place in the file; 'pixels' is the first pixel
+after the header, rows are 3 * 'width' bytes
+*/
+typedef struct MappedPpm
+{
+    int fd;
+    unsigned char* map;
+    unsigned char* pixels;
+    size_t bytes;
+    int width, height;
+} MappedPpm;
+
+/**
+Creates (or truncates) 'path', sizes it for a 'width' * 'height' image,
+writes the header and maps it; returns 0, or -1 with errno set
+*/
+int mapped_open(MappedPpm* ppm, const char* path, int width, int height);
+
+/**
+Address of pixel ('y', 'x')
+*/
+static inline unsigned char* mapped_at(const MappedPpm* ppm, int y, int x)
+{
+    return ppm->pixels + ((size_t) y * ppm->width + x) * 3;
+}
+
+/**
+Starts writing back 'rows' rows from 'y' (MS_ASYNC), or waits for them to be
+written (MS_SYNC), and tells the kernel they will not be touched again
+*/
+int mapped_sync(MappedPpm* ppm, int y, int rows, int flags);
+
+/**
+Unmaps and closes the file; anything not yet synced is written back by the
+kernel as usual
+*/
+int mapped_close(MappedPpm* ppm);
+
+#endif
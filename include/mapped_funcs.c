@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "mapped.h"
+
+/**
+File mapping function
+*/
+int mapped_open(MappedPpm* ppm, const char* path, int width, int height)
+{
+    int header;
+
+    ppm->width = width;
+    ppm->height = height;
+    ppm->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if(ppm->fd < 0)
+        return -1;
+
+    header = dprintf(ppm->fd, "P6\n%d %d 255\n", width, height);
+    ppm->bytes = header + (size_t) 3 * width * height;
+
+    if(header < 0 || ftruncate(ppm->fd, ppm->bytes) != 0) {
+        close(ppm->fd);
+        return -1;
+    }
+
+    ppm->map = (unsigned char *)mmap(NULL, ppm->bytes, PROT_READ | PROT_WRITE, MAP_SHARED, ppm->fd, 0);
+
+    if(ppm->map == MAP_FAILED) {
+        close(ppm->fd);
+        return -1;
+    }
+
+    ppm->pixels = ppm->map + header;
+
+    return 0;
+}
+
+/**
+Row syncing function
+*/
+int mapped_sync(MappedPpm* ppm, int y, int rows, int flags)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    unsigned char* start = mapped_at(ppm, y, 0);
+    unsigned char* end = mapped_at(ppm, y + rows, 0);
+    int err;
+
+    /** msync() needs a page aligned start */
+    start = ppm->map + (start - ppm->map) / page * page;
+
+    err = msync(start, end - start, flags);
+
+    /** Drops them from this mapping only, they stay in the page cache */
+    if(err == 0)
+        madvise(start, end - start, MADV_DONTNEED);
+
+    return err;
+}
+
+/**
+File unmapping function
+*/
+int mapped_close(MappedPpm* ppm)
+{
+    int err = munmap(ppm->map, ppm->bytes);
+
+    return close(ppm->fd) || err;
+}
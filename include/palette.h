@@ -0,0 +1,55 @@
+#ifndef PALETTE_HEAD
+#define PALETTE_HEAD
+
+#include <stdio.h>
+#include <stddef.h>
+#include "frame.h"
+#include "sched.h"
+
+/**
+Colour stops a gradient palette may have at most
+*/
+#define PALETTE_MAX_STOPS 16
+
+/**
+Rows of a frame coloured by one task of palette_frame()
+*/
+#define PALETTE_TASK_ROWS 16
+
+/**
+Builds the lookup table every count is coloured through, one entry for each
+count from 0 to 'max_count'; larger counts take the colour of 'max_count'.
+'spec' is "classic" (plot_pixel()), one of the gradients "grey", "fire" or
+"ocean", or a gradient of its own given as comma separated hex colours from
+count 0 upwards ("#000000,#ff8000,#ffffff"). Gradients colour 'max_count',
+the points that never escaped, black. Every process that colours pixels
+selects the same palette; until one is selected plot_pixel() is used
+directly. Returns 0, or -1 if 'spec' is not understood
+*/
+int palette_select(const char* spec, int max_count);
+
+/**
+Colours 'n' int counts into 'rgb', three bytes per pixel, with a gather from
+the table (eight at a time where AVX2 is available)
+*/
+void palette_row(const int* counts, unsigned char* rgb, size_t n);
+
+/**
+palette_row() for unsigned short counts
+*/
+void palette_row16(const unsigned short* counts, unsigned char* rgb, size_t n);
+
+/**
+Colours 'frame' and writes it to 'img' row by row. Frames of int or unsigned
+short counts are coloured through the table, frames of three byte pixels are
+already coloured. Bands of PALETTE_TASK_ROWS rows are coloured in parallel on
+'pool' if it is not NULL
+*/
+void palette_frame(const Frame* frame, FILE* img, SchedPool* pool);
+
+/**
+Frees the table
+*/
+void palette_release(void);
+
+#endif
@@ -0,0 +1,310 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <immintrin.h>
+#include "palette.h"
+#include "plot.h"
+
+typedef void (*PaletteRowFn)(const int*, unsigned char*, size_t);
+typedef void (*PaletteRow16Fn)(const unsigned short*, unsigned char*, size_t);
+
+/**
+A named gradient, its stops from count 0 upwards
+*/
+typedef struct PaletteGradient
+{
+    const char* name;
+    const char* stops;
+} PaletteGradient;
+
+static const PaletteGradient palette_gradients[] = {
+    {"grey", "#000000,#ffffff"},
+    {"fire", "#000000,#800000,#ff4000,#ffc000,#ffffff"},
+    {"ocean", "#000010,#003070,#00a0c0,#c0f0ff"}
+};
+
+static void palette_row_scalar(const int* counts, unsigned char* rgb, size_t n);
+static void palette_row16_scalar(const unsigned short* counts, unsigned char* rgb, size_t n);
+static void palette_row_avx2(const int* counts, unsigned char* rgb, size_t n);
+static void palette_row16_avx2(const unsigned short* counts, unsigned char* rgb, size_t n);
+
+/** R, G, B and a pad byte per count, so an entry is one 32-bit gather */
+static uint32_t* palette_lut = NULL;
+static int palette_max = 0;
+static PaletteRowFn palette_impl = palette_row_scalar;
+static PaletteRow16Fn palette_impl16 = palette_row16_scalar;
+
+/**
+Reads up to PALETTE_MAX_STOPS comma separated hex colours into 'stops';
+returns how many, or -1 if 'spec' is malformed
+*/
+static int palette_parse(const char* spec, unsigned char stops[][3])
+{
+    unsigned int r, g, b;
+    int n = 0, len;
+
+    while(*spec) {
+        if(*spec == '#')
+            spec++;
+
+        if(n == PALETTE_MAX_STOPS || sscanf(spec, "%2x%2x%2x%n", &r, &g, &b, &len) != 3 || len != 6)
+            return -1;
+
+        stops[n][0] = r;
+        stops[n][1] = g;
+        stops[n][2] = b;
+        n++;
+        spec += len;
+
+        if(*spec == ',')
+            spec++;
+        else if(*spec)
+            return -1;
+    }
+
+    return n;
+}
+
+/**
+Palette selecting function
+*/
+int palette_select(const char* spec, int max_count)
+{
+    unsigned char stops[PALETTE_MAX_STOPS][3];
+    unsigned char entry[4] = {0, 0, 0, 0};
+    uint32_t* lut;
+    double t;
+    int k, i, s, nstops = 0;
+
+    if(max_count < 0)
+        return -1;
+
+    lut = (uint32_t *)malloc(((size_t) max_count + 1) * sizeof(uint32_t));
+
+    if(strcmp(spec, "classic") == 0) {
+        for(k = 0; k <= max_count; k++) {
+            plot_pixel(k, entry);
+            memcpy(&lut[k], entry, 4);
+        }
+    } else {
+        for(i = 0; i < (int)(sizeof(palette_gradients) / sizeof(palette_gradients[0])); i++)
+            if(strcmp(spec, palette_gradients[i].name) == 0)
+                spec = palette_gradients[i].stops;
+
+        nstops = palette_parse(spec, stops);
+
+        if(nstops < 2) {
+            free(lut);
+            return -1;
+        }
+
+        /** Square root spacing, most of the image escapes within a few iterations */
+        for(k = 0; k < max_count; k++) {
+            t = sqrt(k / (double) max_count) * (nstops - 1);
+            s = (int) t;
+            t -= s;
+
+            for(i = 0; i < 3; i++)
+                entry[i] = (unsigned char)(stops[s][i] + t * (stops[s + 1][i] - stops[s][i]) + 0.5);
+
+            memcpy(&lut[k], entry, 4);
+        }
+
+        /** Never escaped */
+        lut[max_count] = 0;
+    }
+
+    free(palette_lut);
+    palette_lut = lut;
+    palette_max = max_count;
+
+    __builtin_cpu_init();
+
+    if(__builtin_cpu_supports("avx2")) {
+        palette_impl = palette_row_avx2;
+        palette_impl16 = palette_row16_avx2;
+    } else {
+        palette_impl = palette_row_scalar;
+        palette_impl16 = palette_row16_scalar;
+    }
+
+    return 0;
+}
+
+/**
+Row colouring function
+*/
+void palette_row(const int* counts, unsigned char* rgb, size_t n)
+{
+    size_t k;
+
+    if(palette_lut == NULL) {
+        for(k = 0; k < n; k++)
+            plot_pixel(counts[k], rgb + 3 * k);
+
+        return;
+    }
+
+    palette_impl(counts, rgb, n);
+}
+
+/**
+Short row colouring function
+*/
+void palette_row16(const unsigned short* counts, unsigned char* rgb, size_t n)
+{
+    size_t k;
+
+    if(palette_lut == NULL) {
+        for(k = 0; k < n; k++)
+            plot_pixel(counts[k], rgb + 3 * k);
+
+        return;
+    }
+
+    palette_impl16(counts, rgb, n);
+}
+
+/**
+Rows 'y0' to 'y0' + 'rows' - 1 of 'frame' being coloured into 'rgb'
+*/
+typedef struct PaletteJob
+{
+    const Frame* frame;
+    unsigned char* rgb;
+    int y0, rows;
+} PaletteJob;
+
+/**
+Colours band 'task' of the rows in 'arg'
+*/
+static void palette_task(void* arg, int task, int thread)
+{
+    PaletteJob* job = (PaletteJob*) arg;
+    const Frame* frame = job->frame;
+    int y, end = (task + 1) * PALETTE_TASK_ROWS < job->rows ? (task + 1) * PALETTE_TASK_ROWS : job->rows;
+    unsigned char* line;
+    const void* row;
+
+    (void) thread;
+
+    for(y = task * PALETTE_TASK_ROWS; y < end; y++) {
+        row = frame_at(frame, job->y0 + y, 0);
+        line = job->rgb + (size_t) y * 3 * frame->width;
+
+        if(frame->elem == sizeof(int))
+            palette_row((const int*) row, line, frame->width);
+        else if(frame->elem == sizeof(unsigned short))
+            palette_row16((const unsigned short*) row, line, frame->width);
+        else
+            memcpy(line, row, 3 * (size_t) frame->width);
+    }
+}
+
+/**
+Frame colouring function
+*/
+void palette_frame(const Frame* frame, FILE* img, SchedPool* pool)
+{
+    PaletteJob job;
+    int block = PALETTE_TASK_ROWS * (pool ? 4 * sched_threads(pool) : 1);
+
+    job.frame = frame;
+    job.rgb = (unsigned char *)malloc((size_t) 3 * frame->width * block);
+
+    /** A block of bands at a time, written out before the next is coloured */
+    for(job.y0 = 0; job.y0 < frame->height; job.y0 += block) {
+        job.rows = frame->height - job.y0 < block ? frame->height - job.y0 : block;
+
+        if(pool)
+            sched_run(pool, (job.rows + PALETTE_TASK_ROWS - 1) / PALETTE_TASK_ROWS, palette_task, &job);
+        else
+            palette_task(&job, 0, 0);
+
+        fwrite(job.rgb, 1, (size_t) 3 * frame->width * job.rows, img);
+    }
+
+    free(job.rgb);
+}
+
+/**
+Palette freeing function
+*/
+void palette_release(void)
+{
+    free(palette_lut);
+    palette_lut = NULL;
+}
+
+/**
+Scalar fallback, also used for the tails of the vector versions; the clamp
+compiles to conditional moves
+*/
+static void palette_row_scalar(const int* counts, unsigned char* rgb, size_t n)
+{
+    size_t k;
+    int c;
+
+    for(k = 0; k < n; k++) {
+        c = counts[k] < palette_max ? counts[k] : palette_max;
+        c = c > 0 ? c : 0;
+        memcpy(rgb + 3 * k, &palette_lut[c], 3);
+    }
+}
+
+static void palette_row16_scalar(const unsigned short* counts, unsigned char* rgb, size_t n)
+{
+    size_t k;
+    int c;
+
+    for(k = 0; k < n; k++) {
+        c = counts[k] < palette_max ? counts[k] : palette_max;
+        memcpy(rgb + 3 * k, &palette_lut[c], 3);
+    }
+}
+
+/**
+Gathers the entries of eight counts and stores their 24 colour bytes at
+'rgb'; the second store runs 4 bytes past them, which the caller leaves room
+for
+*/
+__attribute__((target("avx2")))
+static inline void palette_gather_avx2(__m256i idx, unsigned char* rgb)
+{
+    const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                          0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    __m256i entries;
+
+    idx = _mm256_min_epi32(_mm256_max_epi32(idx, _mm256_setzero_si256()), _mm256_set1_epi32(palette_max));
+    entries = _mm256_shuffle_epi8(_mm256_i32gather_epi32((const int*) palette_lut, idx, 4), pack);
+
+    _mm_storeu_si128((__m128i*) rgb, _mm256_castsi256_si128(entries));
+    _mm_storeu_si128((__m128i*)(rgb + 12), _mm256_extracti128_si256(entries, 1));
+}
+
+/**
+Eight pixels per gather, stopping while two more pixels remain to take the
+overrun
+*/
+__attribute__((target("avx2")))
+static void palette_row_avx2(const int* counts, unsigned char* rgb, size_t n)
+{
+    size_t k;
+
+    for(k = 0; k + 10 <= n; k += 8)
+        palette_gather_avx2(_mm256_loadu_si256((const __m256i*)(counts + k)), rgb + 3 * k);
+
+    palette_row_scalar(counts + k, rgb + 3 * k, n - k);
+}
+
+__attribute__((target("avx2")))
+static void palette_row16_avx2(const unsigned short* counts, unsigned char* rgb, size_t n)
+{
+    size_t k;
+
+    for(k = 0; k + 10 <= n; k += 8)
+        palette_gather_avx2(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(counts + k))), rgb + 3 * k);
+
+    palette_row16_scalar(counts + k, rgb + 3 * k, n - k);
+}
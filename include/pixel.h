@@ -0,0 +1,117 @@
+#ifndef PIXEL_HEAD
+#define PIXEL_HEAD
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "mpi.h"
+#include "palette.h"
+
+/**
+How the MPI drivers hold pixels in their buffers, messages and the master's
+image, chosen at compile time with -DPIXEL_FORMAT=...:
+    PIXEL_INT     iteration counts as int, as originally
+    PIXEL_COUNT16 iteration counts as unsigned short (the default; counts
+                  never go past MAX_ITER + 1)
+    PIXEL_RGB     pixels already coloured, three bytes each
+A one byte palette index is not offered; a palette may have more than 256
+colours
+*/
+#define PIXEL_INT 0
+#define PIXEL_COUNT16 1
+#define PIXEL_RGB 2
+
+#ifndef PIXEL_FORMAT
+#define PIXEL_FORMAT PIXEL_COUNT16
+#endif
+
+/**
+PIXEL_COUNT_MAX is the highest count a pixel_t holds
+*/
+#if PIXEL_FORMAT == PIXEL_INT
+typedef int pixel_t;
+#define PIXEL_COUNT_MAX INT_MAX
+#elif PIXEL_FORMAT == PIXEL_COUNT16
+typedef unsigned short pixel_t;
+#define PIXEL_COUNT_MAX USHRT_MAX
+#elif PIXEL_FORMAT == PIXEL_RGB
+typedef struct pixel_t
+{
+    unsigned char rgb[3];
+} pixel_t;
+#define PIXEL_COUNT_MAX INT_MAX
+#else
+#error "PIXEL_FORMAT must be PIXEL_INT, PIXEL_COUNT16 or PIXEL_RGB"
+#endif
+
+/**
+Creates and commits the MPI type of one pixel_t; free it with MPI_Type_free()
+*/
+static inline void pixel_type_create(MPI_Datatype* type)
+{
+#if PIXEL_FORMAT == PIXEL_INT
+    MPI_Type_contiguous(1, MPI_INT, type);
+#elif PIXEL_FORMAT == PIXEL_COUNT16
+    MPI_Type_contiguous(1, MPI_UNSIGNED_SHORT, type);
+#else
+    MPI_Type_contiguous(3, MPI_UNSIGNED_CHAR, type);
+#endif
+    MPI_Type_commit(type);
+}
+
+/**
+Packs the 'h' * 'w' block of iteration counts in 'counts' ('stride' ints
+between rows) into 'px' ('px_stride' pixels between rows)
+*/
+static inline void pixel_pack(const int* counts, int stride, int h, int w, pixel_t* px, int px_stride)
+{
+    int i;
+#if PIXEL_FORMAT == PIXEL_RGB
+
+    for(i = 0; i < h; i++)
+        palette_row(counts + i * stride, px[(size_t) i * px_stride].rgb, w);
+#else
+    int j;
+
+    for(i = 0; i < h; i++)
+        for(j = 0; j < w; j++)
+            px[(size_t) i * px_stride + j] = (pixel_t) counts[i * stride + j];
+#endif
+}
+
+/**
+Unpacks the 'h' * 'w' block of pixels in 'px' ('px_stride' pixels between
+rows) back into iteration counts in 'counts' ('stride' ints between rows);
+returns -1 if the pixels are already coloured and hold no counts
+*/
+static inline int pixel_unpack(const pixel_t* px, int px_stride, int h, int w, int* counts, int stride)
+{
+#if PIXEL_FORMAT == PIXEL_RGB
+    return -1;
+#else
+    int i, j;
+
+    for(i = 0; i < h; i++)
+        for(j = 0; j < w; j++)
+            counts[i * stride + j] = px[(size_t) i * px_stride + j];
+
+    return 0;
+#endif
+}
+
+/**
+Colours 'n' pixels into 'rgb', three bytes per pixel
+*/
+static inline void pixel_plot_row(const pixel_t* px, unsigned char* rgb, size_t n)
+{
+#if PIXEL_FORMAT == PIXEL_RGB
+    memcpy(rgb, px, 3 * n);
+#elif PIXEL_FORMAT == PIXEL_COUNT16
+    palette_row16(px, rgb, n);
+#else
+    palette_row(px, rgb, n);
+#endif
+}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef PLOT_HEAD
+#define PLOT_HEAD
+
+/**
+Colour intensity of one pixel from its iteration count, written to 'rgb' as
+one byte each for R, G, and B; the "classic" palette (see palette.h), which
+colours whole images through a table built from it
+*/
+static inline void plot_pixel(int count, unsigned char* rgb)
+{
+    if(count <= 63) {
+        rgb[0] = 255;
+        rgb[1] = rgb[2] = 255 - 4 * count;
+    } else {
+        rgb[0] = 255;
+        rgb[1] = count - 63;
+        rgb[2] = 0;
+    }
+
+    if(count == 320)
+        rgb[0] = rgb[1] = rgb[2] = 255;
+}
+
+#endif
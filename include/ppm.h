@@ -0,0 +1,46 @@
+#ifndef PPM_HEAD
+#define PPM_HEAD
+
+#include "mpi.h"
+
+/**
+A P6 image shared between the ranks of a communicator and written with
+MPI-IO, each rank writing its own pixels in place so no rank has to hold the
+whole image. 'header' is the byte length of the P6 header
+*/
+typedef struct PpmFile
+{
+    MPI_File fh;
+    MPI_Offset header;
+    int width, height;
+} PpmFile;
+
+/**
+Collectively opens 'path' for a 'width' * 'height' image, sized to fit it
+exactly; rank 0 writes the header. Returns an MPI error code
+*/
+int ppm_open(PpmFile* ppm, MPI_Comm comm, const char* path, int width, int height);
+
+/**
+Builds the types for writing square tiles 'tile_w' pixels wide, numbered
+row-major across the image: 'ntiles' tiles with numbers 'tiles', stored one
+after another (each row-major, three bytes per pixel) in the order listed.
+'memtype' picks the bytes out of that buffer in file order and 'filetype'
+places them in the image; both are committed and are the caller's to free
+*/
+void ppm_tiles_types(const PpmFile* ppm, const int* tiles, int ntiles, int tile_w,
+                     MPI_Datatype* memtype, MPI_Datatype* filetype);
+
+/**
+Collectively writes one 'memtype' from 'rgb' through a view of the pixel
+data made from 'filetype', which must be in increasing file order. Returns
+an MPI error code
+*/
+int ppm_write(PpmFile* ppm, const void* rgb, MPI_Datatype memtype, MPI_Datatype filetype);
+
+/**
+Collectively closes the image
+*/
+int ppm_close(PpmFile* ppm);
+
+#endif
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "ppm.h"
+
+/**
+One row of one tile: where it goes in the file and where it is in memory
+*/
+typedef struct PpmSegment
+{
+    MPI_Aint file, mem;
+} PpmSegment;
+
+static int ppm_segment_cmp(const void* a, const void* b)
+{
+    MPI_Aint x = ((const PpmSegment*) a)->file, y = ((const PpmSegment*) b)->file;
+
+    return (x > y) - (x < y);
+}
+
+/**
+Image opening function
+*/
+int ppm_open(PpmFile* ppm, MPI_Comm comm, const char* path, int width, int height)
+{
+    char header[64];
+    int rank, err;
+
+    MPI_Comm_rank(comm, &rank);
+
+    ppm->width = width;
+    ppm->height = height;
+    ppm->header = snprintf(header, sizeof(header), "P6\n%d %d 255\n", width, height);
+
+    err = MPI_File_open(comm, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &ppm->fh);
+
+    if(err != MPI_SUCCESS)
+        return err;
+
+    /** Drop anything left from a bigger image */
+    err = MPI_File_set_size(ppm->fh, ppm->header + (MPI_Offset) 3 * width * height);
+
+    if(err == MPI_SUCCESS && rank == 0)
+        err = MPI_File_write_at(ppm->fh, 0, header, (int) ppm->header, MPI_CHAR, MPI_STATUS_IGNORE);
+
+    return err;
+}
+
+/**
+Tile type building function
+*/
+void ppm_tiles_types(const PpmFile* ppm, const int* tiles, int ntiles, int tile_w,
+                     MPI_Datatype* memtype, MPI_Datatype* filetype)
+{
+    int i, r, n = 0, per_row = ppm->width / tile_w;
+    PpmSegment* segs = (PpmSegment *)malloc(((size_t) ntiles * tile_w + 1) * sizeof(PpmSegment));
+    MPI_Aint* displs = (MPI_Aint *)malloc(((size_t) ntiles * tile_w + 1) * sizeof(MPI_Aint));
+    MPI_Aint y, x;
+
+    for(i = 0; i < ntiles; i++) {
+        y = (MPI_Aint)(tiles[i] / per_row) * tile_w;
+        x = (MPI_Aint)(tiles[i] % per_row) * tile_w;
+
+        for(r = 0; r < tile_w; r++, n++) {
+            segs[n].file = ((y + r) * ppm->width + x) * 3;
+            segs[n].mem = ((MPI_Aint) i * tile_w + r) * tile_w * 3;
+        }
+    }
+
+    /** File views have to run forwards through the file */
+    qsort(segs, n, sizeof(PpmSegment), ppm_segment_cmp);
+
+    for(i = 0; i < n; i++)
+        displs[i] = segs[i].mem;
+
+    MPI_Type_create_hindexed_block(n, 3 * tile_w, displs, MPI_BYTE, memtype);
+
+    for(i = 0; i < n; i++)
+        displs[i] = segs[i].file;
+
+    MPI_Type_create_hindexed_block(n, 3 * tile_w, displs, MPI_BYTE, filetype);
+
+    MPI_Type_commit(memtype);
+    MPI_Type_commit(filetype);
+
+    free(segs);
+    free(displs);
+}
+
+/**
+Image writing function
+*/
+int ppm_write(PpmFile* ppm, const void* rgb, MPI_Datatype memtype, MPI_Datatype filetype)
+{
+    int err;
+
+    err = MPI_File_set_view(ppm->fh, ppm->header, MPI_BYTE, filetype, "native", MPI_INFO_NULL);
+
+    if(err != MPI_SUCCESS)
+        return err;
+
+    return MPI_File_write_at_all(ppm->fh, 0, rgb, 1, memtype, MPI_STATUS_IGNORE);
+}
+
+/**
+Image closing function
+*/
+int ppm_close(PpmFile* ppm)
+{
+    return MPI_File_close(&ppm->fh);
+}
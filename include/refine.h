@@ -0,0 +1,31 @@
+#ifndef REFINE_HEAD
+#define REFINE_HEAD
+
+#include <stdio.h>
+#include "kernel.h"
+#include "frame.h"
+
+/**
+Progressive rendering computes a frame of int counts pass by pass: the first
+pass iterates the grid of every 'step'-th pixel, each following pass halves
+'step' until every pixel is on the grid. A pass can be shown as soon as it is
+done, every pixel coloured as the grid pixel at the top left of its block
+*/
+
+/**
+Computes pass 'step' of a progressive render for rows 'y' to 'y' + 'h' - 1 of
+'image': the pixels on the grid of every 'step'-th pixel that are not on the
+previous pass's grid of every 2 * 'step'-th pixel, or all of them when
+'first'. A pixel whose neighbours on the previous grid (the corners of the
+previous pass's cells around it) all have one count takes that count without
+being iterated. Returns the number of pixels filled rather than iterated
+*/
+long refine_rows(const Plane* plane, Frame* image, int step, int first, int y, int h);
+
+/**
+Colours 'image' as it stands after pass 'step' and writes it to 'img', each
+'step' * 'step' block in the colour of its top left pixel
+*/
+void refine_plot(const Frame* image, int step, FILE* img);
+
+#endif
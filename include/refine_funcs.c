@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include <string.h>
+#include "refine.h"
+#include "palette.h"
+
+/**
+Checks whether the previous pass's pixels around ('y', 'x') all have one
+count, and if so gives it to 'out'
+*/
+static int refine_guess(const Frame* image, int y, int x, int step, int* out)
+{
+    int i, j, count = -1, coarse = 2 * step;
+    int y0 = y % coarse ? y - step : y - coarse;
+    int x0 = x % coarse ? x - step : x - coarse;
+    int y1 = y % coarse ? y + step : y + coarse;
+    int x1 = x % coarse ? x + step : x + coarse;
+    const int* row;
+
+    /** Cells off the top or left edge */
+    if(y0 < 0)
+        y0 += coarse;
+
+    if(x0 < 0)
+        x0 += coarse;
+
+    for(i = y0; i <= y1 && i < image->height; i += coarse) {
+        row = (const int*) frame_at(image, i, 0);
+
+        for(j = x0; j <= x1 && j < image->width; j += coarse) {
+            if(count < 0)
+                count = row[j];
+            else if(row[j] != count)
+                return 0;
+        }
+    }
+
+    *out = count;
+
+    return 1;
+}
+
+/**
+Refinement pass function
+*/
+long refine_rows(const Plane* plane, Frame* image, int step, int first, int y, int h)
+{
+    int i, j, k, n, coarse = 2 * step;
+    int max = image->width / step + 1;
+    long filled = 0;
+    int* xs = (int *)malloc(max * sizeof(int));
+    int* counts = (int *)malloc(max * sizeof(int));
+    double* re = (double *)malloc(max * sizeof(double));
+    double* im = (double *)malloc(max * sizeof(double));
+    int* row;
+    Complex z;
+
+    /** First grid row at or below 'y' */
+    for(i = (y + step - 1) / step * step; i < y + h; i += step) {
+        row = (int*) frame_at(image, i, 0);
+        n = 0;
+
+        for(j = 0; j < image->width; j += step) {
+            /** Already computed by an earlier pass */
+            if(!first && i % coarse == 0 && j % coarse == 0)
+                continue;
+
+            if(!first && refine_guess(image, i, j, step, &row[j])) {
+                filled++;
+                continue;
+            }
+
+            z = plane_point(plane, i, j);
+            re[n] = z.re;
+            im[n] = z.im;
+            xs[n++] = j;
+        }
+
+        /** The rest of the row's new pixels in one go */
+        kernel_row_d(re, im, counts, n, plane->c, plane->max_iterations, plane->exponent, 2.0);
+
+        for(k = 0; k < n; k++)
+            row[xs[k]] = counts[k];
+    }
+
+    free(xs);
+    free(counts);
+    free(re);
+    free(im);
+
+    return filled;
+}
+
+/**
+Refinement plotting function
+*/
+void refine_plot(const Frame* image, int step, FILE* img)
+{
+    int i, j;
+    unsigned char* grid = (unsigned char *)malloc(3 * image->width);
+    unsigned char* line = (unsigned char *)malloc(3 * image->width);
+
+    for(i = 0; i < image->height; i++) {
+        /** A new grid row, colour it and widen each grid pixel to its block */
+        if(i % step == 0) {
+            palette_row((const int*) frame_at(image, i, 0), grid, image->width);
+
+            for(j = 0; j < image->width; j++)
+                memcpy(line + 3 * j, grid + 3 * (j - j % step), 3);
+        }
+
+        fwrite(line, 1, 3 * image->width, img);
+    }
+
+    free(grid);
+    free(line);
+}
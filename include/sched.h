@@ -0,0 +1,39 @@
+#ifndef SCHED_HEAD
+#define SCHED_HEAD
+
+/**
+Task function: runs task number 'task' on worker thread 'thread'
+*/
+typedef void (*SchedTask)(void* arg, int task, int thread);
+
+/**
+A pool of worker threads kept alive between sched_run() calls
+*/
+typedef struct SchedPool SchedPool;
+
+/**
+Starts a pool of 'nthreads' workers, the thread calling sched_run() included
+*/
+SchedPool* sched_create(int nthreads);
+
+/**
+Number of workers in 'pool'
+*/
+int sched_threads(const SchedPool* pool);
+
+/**
+Runs 'task' for every task number in [0, 'ntasks') on the pool and returns
+once all are done. Each thread starts with an even, contiguous share of the
+tasks in its own deque and takes from the bottom of it; a thread whose deque
+runs dry steals the top half of another thread's remaining tasks, so
+expensive regions of the image do not leave threads idle. Returns the number
+of steals
+*/
+long sched_run(SchedPool* pool, int ntasks, SchedTask task, void* arg);
+
+/**
+Stops and frees the pool
+*/
+void sched_destroy(SchedPool* pool);
+
+#endif
@@ -0,0 +1,243 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include "sched.h"
+
+/**
+A deque of task numbers, held as the range [lo, hi) packed into one word so
+that the owner and thieves can both update it with a single compare and swap
+*/
+typedef struct SchedDeque
+{
+    unsigned long long range;
+    /** Keep each deque on its own cache line */
+    char pad[56];
+} SchedDeque;
+
+typedef struct SchedWorker
+{
+    SchedPool* pool;
+    int thread;
+} SchedWorker;
+
+struct SchedPool
+{
+    SchedDeque* deques;
+    SchedWorker* workers;
+    pthread_t* threads;
+    int nthreads;
+
+    /** Current run, published under 'lock' by bumping 'generation' */
+    SchedTask task;
+    void* arg;
+    long steals;
+    int generation, running, stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+};
+
+static unsigned long long sched_pack(unsigned int lo, unsigned int hi)
+{
+    return ((unsigned long long) lo << 32) | hi;
+}
+
+/**
+Takes one task from the bottom of the thread's own deque; -1 when empty
+*/
+static int sched_pop(SchedDeque* deque)
+{
+    unsigned long long range = __atomic_load_n(&deque->range, __ATOMIC_ACQUIRE);
+    unsigned int lo, hi;
+
+    do {
+        lo = range >> 32;
+        hi = (unsigned int) range;
+
+        if(lo >= hi)
+            return -1;
+    } while(!__atomic_compare_exchange_n(&deque->range, &range, sched_pack(lo, hi - 1), 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    return hi - 1;
+}
+
+/**
+Steals the top half of 'victim's tasks into the (empty) deque of 'thief'
+*/
+static int sched_steal(SchedDeque* victim, SchedDeque* thief)
+{
+    unsigned long long range = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+    unsigned int lo, hi, take;
+
+    do {
+        lo = range >> 32;
+        hi = (unsigned int) range;
+
+        if(lo >= hi)
+            return 0;
+
+        take = (hi - lo + 1) / 2;
+    } while(!__atomic_compare_exchange_n(&victim->range, &range, sched_pack(lo + take, hi), 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    __atomic_store_n(&thief->range, sched_pack(lo, lo + take), __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+/**
+One run on one thread: drain own deque, then steal until every deque is empty
+*/
+static void sched_drain(SchedPool* pool, int thread)
+{
+    SchedDeque* own = &pool->deques[thread];
+    int t, v, stolen;
+
+    while(1) {
+        while((t = sched_pop(own)) >= 0)
+            pool->task(pool->arg, t, thread);
+
+        /** Look for a victim, starting with the next thread along */
+        stolen = 0;
+
+        for(v = 1; v < pool->nthreads && !stolen; v++)
+            stolen = sched_steal(&pool->deques[(thread + v) % pool->nthreads], own);
+
+        if(!stolen)
+            break;
+
+        __atomic_add_fetch(&pool->steals, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+Pool thread: wait for a new generation, drain it, report back
+*/
+static void* sched_worker(void* p)
+{
+    SchedWorker* worker = (SchedWorker*) p;
+    SchedPool* pool = worker->pool;
+    int seen = 0;
+
+    while(1) {
+        pthread_mutex_lock(&pool->lock);
+
+        while(pool->generation == seen && !pool->stopping)
+            pthread_cond_wait(&pool->start, &pool->lock);
+
+        if(pool->stopping) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        sched_drain(pool, worker->thread);
+
+        pthread_mutex_lock(&pool->lock);
+
+        if(--pool->running == 0)
+            pthread_cond_signal(&pool->done);
+
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+/**
+Pool creation
+*/
+SchedPool* sched_create(int nthreads)
+{
+    SchedPool* pool = (SchedPool *)calloc(1, sizeof(SchedPool));
+    int i;
+
+    if(nthreads < 1)
+        nthreads = 1;
+
+    pool->nthreads = nthreads;
+    pool->deques = (SchedDeque *)calloc(nthreads, sizeof(SchedDeque));
+    pool->workers = (SchedWorker *)malloc(nthreads * sizeof(SchedWorker));
+    pool->threads = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    /** Calling thread is worker 0 */
+    for(i = 0; i < nthreads; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].thread = i;
+
+        if(i > 0)
+            pthread_create(&pool->threads[i], NULL, sched_worker, &pool->workers[i]);
+    }
+
+    return pool;
+}
+
+/**
+Pool size
+*/
+int sched_threads(const SchedPool* pool)
+{
+    return pool->nthreads;
+}
+
+/**
+Scheduling function
+*/
+long sched_run(SchedPool* pool, int ntasks, SchedTask task, void* arg)
+{
+    int i, n = pool->nthreads;
+
+    /** Even, contiguous initial shares */
+    for(i = 0; i < n; i++)
+        pool->deques[i].range = sched_pack((long) ntasks * i / n, (long) ntasks * (i + 1) / n);
+
+    pool->task = task;
+    pool->arg = arg;
+    pool->steals = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->running = n - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    sched_drain(pool, 0);
+
+    /** Wait for the other threads to finish */
+    pthread_mutex_lock(&pool->lock);
+
+    while(pool->running > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return pool->steals;
+}
+
+/**
+Pool destruction
+*/
+void sched_destroy(SchedPool* pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(i = 1; i < pool->nthreads; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    free(pool->workers);
+    free(pool->deques);
+    free(pool);
+}
@@ -0,0 +1,59 @@
+#ifndef STATE_HEAD
+#define STATE_HEAD
+
+#include "kernel.h"
+#include "frame.h"
+
+/**
+Rows of the image carried on by one call of state_band()
+*/
+#define STATE_BAND_ROWS 16
+
+/**
+Where a render stopped: the count of every pixel of 'image' (a frame of
+ints) and, for each pixel that had not escaped by the cap 'max_iterations',
+the z it stopped at, in row order. Band b of STATE_BAND_ROWS rows keeps its
+points in 'z' from 'starts'[b] on, 'found'[b] of them once it has been run.
+A 'max_iterations' of 0 means nothing has been computed yet and every pixel
+starts from its own point on the plane
+*/
+typedef struct IterState
+{
+    Frame* image;
+    int max_iterations;
+    Complex* z;
+    long* starts;
+    long* found;
+    int bands;
+} IterState;
+
+/**
+Sets 'state' up to render 'plane' into 'image'. If 'path' holds the state of
+a render of the same region (everything in 'plane' bar max_iterations, with
+the same periodicity tolerance) stopped at a cap no higher than
+plane->max_iterations, its counts are read into 'image' and the render
+carries on from it; otherwise it starts from scratch. Returns 1 when
+carrying on, 0 when starting from scratch, -1 if the memory for the state
+could not be allocated
+*/
+int state_load(IterState* state, const char* path, const Plane* plane, Frame* image);
+
+/**
+Iterates the pixels of band 'band' that had not escaped on to
+plane->max_iterations, keeping the z of those that still have not; returns
+the number of pixels iterated. Bands can be run in parallel
+*/
+long state_band(IterState* state, const Plane* plane, int band);
+
+/**
+Writes the state to 'path' once every band has been run, replacing the file
+in one rename; returns 0, or -1 if it could not be written
+*/
+int state_save(const IterState* state, const char* path, const Plane* plane);
+
+/**
+Frees the state; the image is left to its owner
+*/
+void state_release(IterState* state);
+
+#endif
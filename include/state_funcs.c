@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "state.h"
+
+/**
+Start of every state file; the digit is bumped whenever the layout changes
+*/
+#define STATE_MAGIC "FRSTATE1"
+
+/**
+Pixels handed to kernel_row_z() at a time
+*/
+#define STATE_BATCH 256
+
+/**
+State file header, followed by the counts row by row (ints), the number of
+points that had not escaped (a long) and their z, in row order
+*/
+typedef struct StateHeader
+{
+    char magic[8];
+    Complex c, centre;
+    double scale, tolerance;
+    int max_iterations, exponent;
+    int width, height, transpose;
+    int pad;
+} StateHeader;
+
+static void state_header(StateHeader* header, const Plane* plane)
+{
+    /** No padding is left uninitialised in the file */
+    memset(header, 0, sizeof(StateHeader));
+
+    memcpy(header->magic, STATE_MAGIC, sizeof(header->magic));
+    header->c = plane->c;
+    header->centre = plane->centre;
+    header->scale = plane->scale;
+    header->tolerance = kernel_period_tolerance();
+    header->max_iterations = plane->max_iterations;
+    header->exponent = plane->exponent;
+    header->width = plane->width;
+    header->height = plane->height;
+    header->transpose = plane->transpose;
+}
+
+/**
+Reads the counts and points of 'path' into 'state' if it is a render of the
+same region with a cap no higher than the plane's; returns 1 if it was read
+*/
+static int state_read(IterState* state, const char* path, const Plane* plane)
+{
+    StateHeader want, got;
+    FILE* file = fopen(path, "rb");
+    long n, total = 0;
+    int b, i, j, y, *row;
+
+    if(file == NULL)
+        return 0;
+
+    state_header(&want, plane);
+
+    if(fread(&got, sizeof(got), 1, file) != 1 || memcmp(got.magic, want.magic, sizeof(got.magic)) != 0 ||
+       got.c.re != want.c.re || got.c.im != want.c.im || got.centre.re != want.centre.re ||
+       got.centre.im != want.centre.im || got.scale != want.scale || got.tolerance != want.tolerance ||
+       got.exponent != want.exponent || got.width != want.width || got.height != want.height ||
+       got.transpose != want.transpose || got.max_iterations < 1 ||
+       got.max_iterations > want.max_iterations) {
+        fclose(file);
+        return 0;
+    }
+
+    for(i = 0; i < plane->height; i++)
+        if(fread(frame_at(state->image, i, 0), sizeof(int), plane->width, file) != (size_t) plane->width) {
+            fclose(file);
+            return 0;
+        }
+
+    /** Each band's points follow on from the band above */
+    for(b = 0; b < state->bands; b++) {
+        state->starts[b] = total;
+
+        for(y = b * STATE_BAND_ROWS; y < (b + 1) * STATE_BAND_ROWS && y < plane->height; y++) {
+            row = (int*) frame_at(state->image, y, 0);
+
+            for(j = 0; j < plane->width; j++)
+                total += row[j] == got.max_iterations;
+        }
+    }
+
+    if(fread(&n, sizeof(n), 1, file) != 1 || n != total) {
+        fclose(file);
+        return 0;
+    }
+
+    state->z = (Complex *)malloc((n > 0 ? n : 1) * sizeof(Complex));
+
+    if(state->z == NULL || fread(state->z, sizeof(Complex), n, file) != (size_t) n) {
+        free(state->z);
+        state->z = NULL;
+        fclose(file);
+        return 0;
+    }
+
+    fclose(file);
+    state->max_iterations = got.max_iterations;
+
+    return 1;
+}
+
+/**
+State loading function
+*/
+int state_load(IterState* state, const char* path, const Plane* plane, Frame* image)
+{
+    int b;
+
+    state->image = image;
+    state->bands = (plane->height + STATE_BAND_ROWS - 1) / STATE_BAND_ROWS;
+    state->starts = (long *)malloc(state->bands * sizeof(long));
+    state->found = (long *)calloc(state->bands, sizeof(long));
+    state->max_iterations = 0;
+    state->z = NULL;
+
+    if(state_read(state, path, plane))
+        return 1;
+
+    /** From scratch, room for every pixel of each band to be left over */
+    state->z = (Complex *)malloc((size_t) plane->width * plane->height * sizeof(Complex));
+
+    if(state->z == NULL)
+        return -1;
+
+    for(b = 0; b < state->bands; b++)
+        state->starts[b] = (long) b * STATE_BAND_ROWS * plane->width;
+
+    return 0;
+}
+
+/**
+Iterates a batch of 'n' points (pixel 'pos'[m] / width, 'pos'[m] % width),
+appending those that still have not escaped to 'z' at '*out'
+*/
+static void state_flush(IterState* state, const Plane* plane, double* re, double* im, int* counts,
+                        const long* pos, int n, long* out)
+{
+    int m, cap = plane->max_iterations - state->max_iterations;
+
+    kernel_row_z(re, im, counts, n, plane->c, cap, plane->exponent);
+
+    for(m = 0; m < n; m++) {
+        *(int*) frame_at(state->image, pos[m] / plane->width, pos[m] % plane->width) = state->max_iterations + counts[m];
+
+        if(counts[m] == cap) {
+            state->z[*out].re = re[m];
+            state->z[*out].im = im[m];
+            (*out)++;
+        }
+    }
+}
+
+/**
+Band carrying function
+*/
+long state_band(IterState* state, const Plane* plane, int band)
+{
+    double re[STATE_BATCH], im[STATE_BATCH];
+    int counts[STATE_BATCH];
+    long pos[STATE_BATCH];
+    long in = state->starts[band], out = in, iterated = 0;
+    int y, x, n = 0, *row;
+    int y1 = (band + 1) * STATE_BAND_ROWS < plane->height ? (band + 1) * STATE_BAND_ROWS : plane->height;
+    Complex z;
+
+    /** Points are only ever written back over ones already read */
+    for(y = band * STATE_BAND_ROWS; y < y1; y++) {
+        row = (int*) frame_at(state->image, y, 0);
+
+        for(x = 0; x < plane->width; x++) {
+            if(state->max_iterations > 0 && row[x] != state->max_iterations)
+                continue;
+
+            z = state->max_iterations > 0 ? state->z[in++] : plane_point(plane, y, x);
+            re[n] = z.re;
+            im[n] = z.im;
+            pos[n++] = (long) y * plane->width + x;
+
+            if(n == STATE_BATCH) {
+                state_flush(state, plane, re, im, counts, pos, n, &out);
+                iterated += n;
+                n = 0;
+            }
+        }
+    }
+
+    state_flush(state, plane, re, im, counts, pos, n, &out);
+    iterated += n;
+    state->found[band] = out - state->starts[band];
+
+    return iterated;
+}
+
+/**
+State saving function
+*/
+int state_save(const IterState* state, const char* path, const Plane* plane)
+{
+    StateHeader header;
+    char part[256];
+    FILE* file;
+    long n = 0;
+    int b, i, ok;
+
+    snprintf(part, sizeof(part), "%s.part", path);
+    file = fopen(part, "wb");
+
+    if(file == NULL)
+        return -1;
+
+    for(b = 0; b < state->bands; b++)
+        n += state->found[b];
+
+    state_header(&header, plane);
+    ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for(i = 0; ok && i < plane->height; i++)
+        ok = fwrite(frame_at(state->image, i, 0), sizeof(int), plane->width, file) == (size_t) plane->width;
+
+    ok = ok && fwrite(&n, sizeof(n), 1, file) == 1;
+
+    for(b = 0; ok && b < state->bands; b++)
+        ok = fwrite(state->z + state->starts[b], sizeof(Complex), state->found[b], file) == (size_t) state->found[b];
+
+    if(fclose(file) != 0 || !ok) {
+        remove(part);
+        return -1;
+    }
+
+    return rename(part, path);
+}
+
+/**
+State releasing function
+*/
+void state_release(IterState* state)
+{
+    free(state->z);
+    free(state->starts);
+    free(state->found);
+}
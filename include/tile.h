@@ -0,0 +1,27 @@
+#ifndef TILE_HEAD
+#define TILE_HEAD
+
+#include "kernel.h"
+
+/**
+Tile width used when a whole image is solved tile by tile
+*/
+#define TILE_WIDTH 64
+
+/**
+Rectangles whose interior is at most this many pixels are iterated directly
+rather than subdivided further
+*/
+#define TILE_MIN_AREA 64
+
+/**
+Solves the 'h' * 'w' tile of 'plane' at ('y', 'x') by rectangle subdivision
+(Mariani-Silver): the tile border is iterated first and, if every border
+pixel has the same count, the interior is filled with it without iterating;
+otherwise the tile is split in two across its longer side and each half is
+solved the same way. Counts go to 'out' with 'stride' ints between rows;
+returns the number of pixels that were filled rather than iterated
+*/
+long tile_solve(const Plane* plane, int y, int x, int h, int w, int* out, int stride);
+
+#endif
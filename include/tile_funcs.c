@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include "tile.h"
+
+/**
+Checks whether the border of the 'h' * 'w' rectangle at 'out' is one count
+*/
+static int tile_border_uniform(const int* out, int h, int w, int stride)
+{
+    int i, first = out[0];
+    const int* bottom = out + (size_t)(h - 1) * stride;
+
+    for(i = 0; i < w; i++)
+        if(out[i] != first || bottom[i] != first)
+            return 0;
+
+    for(i = 1; i < h - 1; i++)
+        if(out[(size_t) i * stride] != first || out[(size_t) i * stride + w - 1] != first)
+            return 0;
+
+    return 1;
+}
+
+/**
+Solves the interior of a rectangle whose border is already in 'out'
+*/
+static long tile_interior(const Plane* plane, int y, int x, int h, int w, int* out, int stride)
+{
+    int i, j, mid;
+    int* row;
+
+    /** No interior left */
+    if(h <= 2 || w <= 2)
+        return 0;
+
+    /** Uniform border, fill */
+    if(tile_border_uniform(out, h, w, stride)) {
+        for(i = 1; i < h - 1; i++) {
+            row = out + (size_t) i * stride;
+
+            for(j = 1; j < w - 1; j++)
+                row[j] = out[0];
+        }
+
+        return (long)(h - 2) * (w - 2);
+    }
+
+    /** Small enough to iterate directly */
+    if((h - 2) * (w - 2) <= TILE_MIN_AREA) {
+        kernel_tile(plane, y + 1, x + 1, h - 2, w - 2, out + stride + 1, stride);
+        return 0;
+    }
+
+    /** Iterate a dividing line across the longer side, which becomes border to both halves */
+    if(h >= w) {
+        mid = h / 2;
+        kernel_tile(plane, y + mid, x + 1, 1, w - 2, out + (size_t) mid * stride + 1, stride);
+
+        return tile_interior(plane, y, x, mid + 1, w, out, stride) +
+               tile_interior(plane, y + mid, x, h - mid, w, out + (size_t) mid * stride, stride);
+    }
+
+    mid = w / 2;
+    kernel_tile(plane, y + 1, x + mid, h - 2, 1, out + stride + mid, stride);
+
+    return tile_interior(plane, y, x, h, mid + 1, out, stride) +
+           tile_interior(plane, y, x + mid, h, w - mid, out + mid, stride);
+}
+
+/**
+Tile solving function
+*/
+long tile_solve(const Plane* plane, int y, int x, int h, int w, int* out, int stride)
+{
+    /** Top and bottom rows */
+    kernel_tile(plane, y, x, 1, w, out, stride);
+
+    if(h > 1)
+        kernel_tile(plane, y + h - 1, x, 1, w, out + (size_t)(h - 1) * stride, stride);
+
+    /** Left and right columns between them */
+    if(h > 2) {
+        kernel_tile(plane, y + 1, x, h - 2, 1, out + stride, stride);
+
+        if(w > 1)
+            kernel_tile(plane, y + 1, x + w - 1, h - 2, 1, out + stride + w - 1, stride);
+    }
+
+    return tile_interior(plane, y, x, h, w, out, stride);
+}
@@ -0,0 +1,67 @@
+#ifndef TRACE_HEAD
+#define TRACE_HEAD
+
+#include "mpi.h"
+
+/**
+What a traced stretch of time went on: computing pixels, sending messages,
+waiting for a message to arrive, or colouring and writing the image. The
+summary counts sends as communication and waits as idle time
+*/
+typedef enum TraceKind
+{
+    TRACE_COMPUTE = 0,
+    TRACE_SEND,
+    TRACE_WAIT,
+    TRACE_WRITE,
+    TRACE_KINDS
+} TraceKind;
+
+/**
+One stretch of time, in seconds from the start of the trace, spent on 'kind'
+by thread 'thread' for chunk (or row of chunks, or frame) 'index', -1 if
+none, with the iterations its pixels stand for and the bytes it sent
+*/
+typedef struct TraceEvent
+{
+    double start, end;
+    long long iterations;
+    long bytes;
+    int kind, index, thread;
+} TraceEvent;
+
+/**
+Events recorded by one thread of a rank, so threads never share a log.
+Nothing is recorded unless the log is 'on'
+*/
+typedef struct TraceLog
+{
+    TraceEvent* events;
+    int n, cap;
+    int on;
+    int thread;
+    double origin;
+} TraceLog;
+
+/**
+Creates 'nlogs' logs, one for each thread of the rank that records events,
+numbered from 0. If 'on', every rank of 'comm' has to call this together:
+the trace starts once they all have
+*/
+TraceLog* trace_create(MPI_Comm comm, int nlogs, int on);
+
+/**
+Records 'kind' from 'start' (MPI_Wtime()) until now in 'log', if it is on
+*/
+void trace_event(TraceLog* log, TraceKind kind, double start, int index, long long iterations, long bytes);
+
+/**
+If the logs are on, collectively gathers every rank's events onto rank 0 of
+'comm', which writes them to 'path' as a Chrome trace (one process per rank,
+one thread per log, named 'names') and prints each rank's time computing,
+communicating, idle and writing, chunks, bytes sent and iterations. Frees
+the logs; returns 0, or -1 if the trace could not be written
+*/
+int trace_finish(TraceLog* logs, int nlogs, const char* const* names, const char* path, MPI_Comm comm);
+
+#endif
@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "trace.h"
+#include "bench.h"
+
+/**
+Names of the kinds of events, as categories in the trace
+*/
+static const char* trace_kinds[TRACE_KINDS] = {"compute", "send", "wait", "write"};
+
+/**
+Log creation
+*/
+TraceLog* trace_create(MPI_Comm comm, int nlogs, int on)
+{
+    TraceLog* logs = (TraceLog *)calloc(nlogs, sizeof(TraceLog));
+    double origin = 0;
+    int i;
+
+    /** Ranks' clocks are lined up on the barrier they all leave together */
+    if(on) {
+        MPI_Barrier(comm);
+        origin = MPI_Wtime();
+    }
+
+    for(i = 0; i < nlogs; i++) {
+        logs[i].on = on;
+        logs[i].thread = i;
+        logs[i].origin = origin;
+    }
+
+    return logs;
+}
+
+/**
+Event recording
+*/
+void trace_event(TraceLog* log, TraceKind kind, double start, int index, long long iterations, long bytes)
+{
+    TraceEvent* event;
+
+    if(!log->on)
+        return;
+
+    if(log->n == log->cap) {
+        log->cap = log->cap ? 2 * log->cap : 256;
+        log->events = (TraceEvent *)realloc(log->events, log->cap * sizeof(TraceEvent));
+    }
+
+    event = &log->events[log->n++];
+    event->end = MPI_Wtime() - log->origin;
+    event->start = start - log->origin;
+    event->iterations = iterations;
+    event->bytes = bytes;
+    event->kind = kind;
+    event->index = index;
+    event->thread = log->thread;
+}
+
+/**
+Summary of each rank's events
+*/
+static void trace_summary(const TraceEvent* events, const int* counts, int nprocs)
+{
+    double time[TRACE_KINDS], *compute = (double *)malloc(nprocs * sizeof(double));
+    long long iterations, max_chunk;
+    long bytes, chunks;
+    int r, k, e, ncompute = 0;
+
+    printf("Trace summary, in seconds:\n");
+    printf("\tRank\tCompute\t\tComm\t\tIdle\t\tWrite\t\tChunks\tBytes sent\tIterations\tMax per chunk\n");
+
+    for(r = 0, e = 0; r < nprocs; r++) {
+        for(k = 0; k < TRACE_KINDS; k++)
+            time[k] = 0;
+
+        iterations = max_chunk = 0;
+        bytes = chunks = 0;
+
+        for(k = 0; k < counts[r]; k++, e++) {
+            time[events[e].kind] += events[e].end - events[e].start;
+            bytes += events[e].bytes;
+            iterations += events[e].iterations;
+
+            if(events[e].kind == TRACE_COMPUTE && events[e].index >= 0) {
+                chunks++;
+
+                if(events[e].iterations > max_chunk)
+                    max_chunk = events[e].iterations;
+            }
+        }
+
+        if(time[TRACE_COMPUTE] > 0)
+            compute[ncompute++] = time[TRACE_COMPUTE];
+
+        printf("\t%d\t%f\t%f\t%f\t%f\t%ld\t%ld\t\t%lld\t%lld\n", r,
+               time[TRACE_COMPUTE], time[TRACE_SEND], time[TRACE_WAIT], time[TRACE_WRITE],
+               chunks, bytes, iterations, max_chunk);
+    }
+
+    printf("\tCompute imbalance (longest over average of ranks that computed):\t%f\n",
+           bench_imbalance(compute, ncompute));
+
+    free(compute);
+}
+
+/**
+Trace gathering and writing
+*/
+int trace_finish(TraceLog* logs, int nlogs, const char* const* names, const char* path, MPI_Comm comm)
+{
+    TraceEvent *mine = NULL, *all = NULL, *event;
+    int *counts = NULL, *displs = NULL, *seen = NULL;
+    int nprocs, rank, n = 0, total = 0, i, r, e, result = 0;
+    char name[32];
+    FILE* file;
+
+    if(!logs[0].on) {
+        free(logs);
+        return 0;
+    }
+
+    MPI_Comm_size(comm, &nprocs);
+    MPI_Comm_rank(comm, &rank);
+
+    /** Every log of the rank one after another, sent as bytes */
+    for(i = 0; i < nlogs; i++)
+        n += logs[i].n;
+
+    mine = (TraceEvent *)malloc((n ? n : 1) * sizeof(TraceEvent));
+
+    for(i = 0, n = 0; i < nlogs; i++) {
+        for(e = 0; e < logs[i].n; e++)
+            mine[n++] = logs[i].events[e];
+
+        free(logs[i].events);
+    }
+
+    free(logs);
+    n *= sizeof(TraceEvent);
+
+    if(rank == 0) {
+        counts = (int *)malloc(nprocs * sizeof(int));
+        displs = (int *)malloc(nprocs * sizeof(int));
+    }
+
+    MPI_Gather(&n, 1, MPI_INT, counts, 1, MPI_INT, 0, comm);
+
+    if(rank == 0) {
+        for(r = 0; r < nprocs; r++) {
+            displs[r] = total;
+            total += counts[r];
+        }
+
+        all = (TraceEvent *)malloc(total ? total : 1);
+    }
+
+    MPI_Gatherv(mine, n, MPI_BYTE, all, counts, displs, MPI_BYTE, 0, comm);
+    free(mine);
+
+    if(rank != 0)
+        return 0;
+
+    for(r = 0; r < nprocs; r++)
+        counts[r] /= sizeof(TraceEvent);
+
+    trace_summary(all, counts, nprocs);
+
+    file = fopen(path, "w");
+
+    if(file == NULL)
+        result = -1;
+    else {
+        fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+        seen = (int *)malloc(nlogs * sizeof(int));
+
+        for(r = 0, e = 0; r < nprocs; r++) {
+            fprintf(file, "%s\n{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"rank %d\"}}",
+                    r > 0 ? "," : "", r, r);
+
+            for(i = 0; i < nlogs; i++)
+                seen[i] = 0;
+
+            for(i = 0; i < counts[r]; i++, e++) {
+                event = &all[e];
+
+                if(!seen[event->thread]) {
+                    fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                            r, event->thread, names[event->thread]);
+                    seen[event->thread] = 1;
+                }
+
+                /** Named after what it was for, if anything */
+                if(event->index >= 0)
+                    snprintf(name, sizeof(name), "%s %d", trace_kinds[event->kind], event->index);
+                else
+                    snprintf(name, sizeof(name), "%s", trace_kinds[event->kind]);
+
+                fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                        "\"pid\": %d, \"tid\": %d, \"args\": {\"iterations\": %lld, \"bytes\": %ld}}",
+                        name, trace_kinds[event->kind],
+                        event->start * 1e6, (event->end - event->start) * 1e6,
+                        r, event->thread, event->iterations, event->bytes);
+            }
+        }
+
+        fprintf(file, "\n]}\n");
+
+        if(fclose(file) != 0)
+            result = -1;
+
+        free(seen);
+    }
+
+    free(all);
+    free(counts);
+    free(displs);
+
+    return result;
+}
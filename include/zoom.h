@@ -0,0 +1,72 @@
+#ifndef ZOOM_HEAD
+#define ZOOM_HEAD
+
+#include "kernel.h"
+#include "ddouble.h"
+
+/**
+Pixel spacing below which a render is a deep zoom. Past this the starting
+points of neighbouring pixels are no longer told apart in double precision
+well enough, so pixels are iterated by perturbation around a reference orbit
+instead (see zoom_tile())
+*/
+#ifndef ZOOM_DEEP_SPACING
+#define ZOOM_DEEP_SPACING 1e-12
+#endif
+
+/**
+Reference orbit of a deep zoom: Z[0] is the plane's centre (kept to full
+double-double precision in 'start_re', 'start_im') and Z[n + 1] = Z[n]^2 + c
+is computed in double-double and rounded into 'z', for 'length' iterations,
+until it escapes or reaches max_iterations. 'rebases' counts the times a
+pixel was moved back to the start of the orbit
+*/
+typedef struct Orbit
+{
+    Complex* z;
+    int length;
+    DDouble start_re, start_im;
+    long rebases;
+} Orbit;
+
+/**
+Sets the viewport of 'plane' from 'spec', "centre_re,centre_im,scale"; the
+centre is read to double-double precision. Returns 0, or -1 if 'spec' is not
+understood or 'scale' is not positive
+*/
+int zoom_viewport(const char* spec, Plane* plane);
+
+/**
+Whether 'plane' is zoomed in far enough to need perturbation
+*/
+static inline int zoom_deep(const Plane* plane)
+{
+    int n = plane->width > plane->height ? plane->width : plane->height;
+
+    return 2.0 * plane->scale / n < ZOOM_DEEP_SPACING;
+}
+
+/**
+Computes the reference orbit of 'plane' into 'orbit', which is z = z^2 + c
+only; returns 0, or -1 if the orbit could not be allocated. Set plane->orbit
+to it for kernel_tile() to render by perturbation
+*/
+int zoom_orbit(Orbit* orbit, const Plane* plane);
+
+/**
+kernel_tile() for a deep zoom. Each pixel is iterated as a double offset
+d from the reference orbit, d' = (2Z + d)d, with the offset of the pixel from
+the centre as d[0]; only the reference needs more precision than double.
+Where the offset stops being small against the orbit, which is where
+perturbation loses precision (a glitch), the pixel is rebased: whenever it
+comes closer to Z[0] than to the point of the orbit it follows, or the orbit
+runs out, it carries on as an offset from Z[0]
+*/
+void zoom_tile(const Plane* plane, int y, int x, int h, int w, int* out, int stride);
+
+/**
+Frees the orbit
+*/
+void zoom_release(Orbit* orbit);
+
+#endif
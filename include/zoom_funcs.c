@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include "zoom.h"
+
+/**
+Viewport parsing function
+*/
+int zoom_viewport(const char* spec, Plane* plane)
+{
+    DDouble re, im;
+    double scale;
+    char* end;
+
+    re = dd_parse(spec, &end);
+
+    if(end == spec || *end != ',')
+        return -1;
+
+    spec = end + 1;
+    im = dd_parse(spec, &end);
+
+    if(end == spec || *end != ',')
+        return -1;
+
+    spec = end + 1;
+    scale = strtod(spec, &end);
+
+    if(end == spec || *end || !(scale > 0))
+        return -1;
+
+    plane->centre.re = re.hi;
+    plane->centre.im = im.hi;
+    plane->centre_lo.re = re.lo;
+    plane->centre_lo.im = im.lo;
+    plane->scale = scale;
+
+    return 0;
+}
+
+/**
+Reference orbit function
+*/
+int zoom_orbit(Orbit* orbit, const Plane* plane)
+{
+    DDouble z_re, z_im, re2, im2, n_re;
+    DDouble c_re = dd_make(plane->c.re, 0), c_im = dd_make(plane->c.im, 0);
+    int n;
+
+    orbit->z = (Complex *)malloc(((size_t) plane->max_iterations + 1) * sizeof(Complex));
+
+    if(orbit->z == NULL)
+        return -1;
+
+    orbit->start_re = z_re = dd_make(plane->centre.re, plane->centre_lo.re);
+    orbit->start_im = z_im = dd_make(plane->centre.im, plane->centre_lo.im);
+    orbit->z[0].re = z_re.hi;
+    orbit->z[0].im = z_im.hi;
+    orbit->rebases = 0;
+
+    for(n = 0; n < plane->max_iterations; n++) {
+        re2 = dd_mul(z_re, z_re);
+        im2 = dd_mul(z_im, z_im);
+        n_re = dd_add(dd_sub(re2, im2), c_re);
+        z_im = dd_add(dd_mul(dd_add(z_re, z_re), z_im), c_im);
+        z_re = n_re;
+
+        orbit->z[n + 1].re = z_re.hi;
+        orbit->z[n + 1].im = z_im.hi;
+
+        if(z_re.hi * z_re.hi + z_im.hi * z_im.hi > 4) {
+            n++;
+            break;
+        }
+    }
+
+    orbit->length = n;
+
+    return 0;
+}
+
+/**
+Perturbation tile
+*/
+void zoom_tile(const Plane* plane, int y, int x, int h, int w, int* out, int stride)
+{
+    const Orbit* orbit = plane->orbit;
+    const Complex* Z = orbit->z;
+    Complex d, t, z, b;
+    long rebases = 0;
+    int i, j, n, m;
+
+    for(i = 0; i < h; i++)
+        for(j = 0; j < w; j++) {
+            d = plane_offset(plane, y + i, x + j);
+            m = 0;
+
+            for(n = 0; n < plane->max_iterations; n++) {
+                /** d' = (2Z + d)d */
+                t.re = 2 * Z[m].re + d.re;
+                t.im = 2 * Z[m].im + d.im;
+                d = cmplx_mul(t, d);
+                m++;
+
+                z.re = Z[m].re + d.re;
+                z.im = Z[m].im + d.im;
+
+                if(cmplx_magnitude(z) > 4)
+                    break;
+
+                /** The same point as an offset from Z[0] */
+                b.re = ((Z[m].re - orbit->start_re.hi) + d.re) - orbit->start_re.lo;
+                b.im = ((Z[m].im - orbit->start_im.hi) + d.im) - orbit->start_im.lo;
+
+                if(m == orbit->length || cmplx_magnitude(b) < cmplx_magnitude(d)) {
+                    d = b;
+                    m = 0;
+                    rebases++;
+                }
+            }
+
+            out[(size_t) i * stride + j] = n;
+        }
+
+    __atomic_fetch_add(&plane->orbit->rebases, rebases, __ATOMIC_RELAXED);
+}
+
+/**
+Orbit freeing function
+*/
+void zoom_release(Orbit* orbit)
+{
+    free(orbit->z);
+}
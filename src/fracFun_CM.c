@@ -1,39 +1,117 @@
 /***************************************************************************
  * Filename: fracFun_CM.c [testing]
- * Usage: mpirun [-np [0-9]] [-machinefile ./path/to/machine-file] ./bin/fracFun_CM
+ * Usage: mpirun [-np [0-9]] [-machinefile ./path/to/machine-file] ./bin/fracFun_CM [-c palette] [-e cell] [-J file] [-m] [-p] [-r] [-T file] [-v centre_re,centre_im,scale]
  * Author: Benjamin J Carrington
  ***************************************************************************/
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <unistd.h>
 #include "mpi.h"
 #include "cmplx.h"
+#include "kernel.h"
+#include "zoom.h"
+#include "ppm.h"
+#include "pixel.h"
+#include "bench.h"
+#include "trace.h"
+#include "balance.h"
 
+/**
+Image and chunk size, and the set rendered; all can be set with -D at compile
+time
+*/
+#ifndef FULL_WIDTH
 #define FULL_WIDTH 16384
+#endif
+#ifndef CHUNK_WIDTH
 #define CHUNK_WIDTH 2
+#endif
+#ifndef MAX_ITER
 #define MAX_ITER 1000
+#endif
+#ifndef C_RE
+#define C_RE -.4
+#endif
+#ifndef C_IM
+#define C_IM .6
+#endif
 
-void plot(int* full_arr, FILE* img);
-long iterator(Complex c, double im, double re);
+/**
+Samples along each side of a cell in the cost pre-pass of -e
+*/
+#define PREPASS_SAMPLES 4
+
+/**
+First column 'col' of chunk row 'row' holding one of 'rank's chunks, and how
+many of them the row holds ('n', 0 if none)
+*/
+void rank_row_chunks(int rank, int numProcs, int row, int* col, int* n);
+
+/**
+Datatype placing the pixels computed by 'rank', held in the order they
+appear in the image, straight into their places in it: for each pixel row, a
+vector of the rank's chunks in that row, every 'numProcs'-th chunk, down to
+row 'height'. 'pixel' is the type of one pixel and 'pitch' the pixels from
+one image row to the next
+*/
+MPI_Datatype rank_rows_type(int rank, int numProcs, MPI_Datatype pixel, int pitch, int height);
+
+/**
+Datatype placing the pixels of the cells 'owner' gives to 'rank', out of
+'ncells' square cells 'cell' pixels wide numbered row-major across the image
+and held one after another in that order, straight into their places in it.
+'pixel' is the type of one pixel and 'pitch' the pixels from one image row
+to the next
+*/
+MPI_Datatype rank_cells_type(const int* owner, int ncells, int rank, int cell, MPI_Datatype pixel, int pitch);
 
 int main(int argc, char* argv[])
 {
-    int *send_arr, *full_arr;
-    int Y_start, X_start, CUR_CHUNK, CHUNK_SQUARED;
-    int i, j, k, LOOPCOUNT;
+    pixel_t *send_arr;
+    Frame full_arr;
+    int counts[CHUNK_WIDTH * CHUNK_WIDTH];
+    int Y_start, X_start, CUR_CHUNK, MY_CHUNKS;
+    int cell = 0, ncells = 0, MY_CELLS = 0;
+    int *owner = NULL, *cells = NULL, *cell_counts;
+    long long* cost;
+    double estimate = 1, prepass_time = 0;
+    size_t npixels;
+    int i, j, k, opt, LOOPCOUNT, mpiio = 0, symmetric = 0, periodic = 0, rows = FULL_WIDTH;
+    int* column;
+    int row = -1, row_col, row_n;
+    size_t row_base = 0;
+    unsigned char* rgb;
     int NUM_CHUNKS = (FULL_WIDTH / CHUNK_WIDTH) * (FULL_WIDTH / CHUNK_WIDTH);
     int NUM_CHUNKS_REMAINING = 0;
-    int disp = 0;
     FILE* img;
+    const char* palette = "classic";
+    const char* viewport = NULL;
+    const char* bench_path = NULL;
+    const char* trace_path = NULL;
+    const char* trace_names[1] = {"main"};
+    char* optEnd_p;
+    TraceLog* trace;
+    double row_since = 0;
+    long long row_before = 0;
+    PpmFile ppm;
     Complex c;
+    Plane plane;
+    Orbit orbit;
+    long total_rebases;
     int pixel_YX[2];
     /** Timing variables */
-    double start, stop;
-    float elapsed_time;
+    double start, stop, since;
+    float elapsed_time, write_time = 0;
+    BenchWork work = {0, 0};
+    BenchRecord record;
 
     /** MPI specific variables */
     MPI_Status status;
     MPI_Request request;
+    MPI_Request* recv_reqs;
+    MPI_Datatype RANK_PIXELS, PIXEL, RGB, memtype;
     int rankID, numProcs, numSlaves;
 
     /** Initialisation of MPI environment */
@@ -42,50 +120,149 @@ int main(int argc, char* argv[])
     MPI_Comm_size(MPI_COMM_WORLD, &numProcs);
     MPI_Comm_rank(MPI_COMM_WORLD, &rankID);
     MPI_Barrier(MPI_COMM_WORLD);
-    MPI_Datatype CHUNKxCHUNK, CHUNKxCHUNK_RE;
-
-    /** Variables for type creation */
-    int full_sizes[2] = {FULL_WIDTH, FULL_WIDTH};
-    int sub_sizes[2] = {CHUNK_WIDTH, CHUNK_WIDTH};
-    int starting[2] = {0, 0};
-    int sendcounts[numProcs];
-    int displs[numProcs];
-
-    /** Create CHUNK by CHUNK type */
-    MPI_Type_create_subarray(
-        2, // Dimensions
-        full_sizes, // Full size
-        sub_sizes, // Interior sizes
-        starting, // Begining offset
-        MPI_ORDER_C, // Ordering in mem
-        MPI_INT, // Data type
-        &CHUNKxCHUNK
-    );
-    /** Specify offset */
-    MPI_Type_create_resized(
-        CHUNKxCHUNK,
-        0, // Lower-boumd
-        CHUNK_WIDTH * sizeof(int), // Upper-bound (starting offset of next block)
-        &CHUNKxCHUNK_RE
-    );
-    /** Commit type to be used */
-    MPI_Type_commit(&CHUNKxCHUNK_RE);
+    /** Options section */
+    while((opt = getopt(argc, argv, "c:e:J:mprT:v:")) != -1) {
+        switch(opt) {
+        case 'c':
+            palette = optarg;
+            break;
+        case 'e':
+            cell = strtol(optarg, &optEnd_p, 10);
+
+            if(*optEnd_p || cell < 1 || FULL_WIDTH % cell != 0) {
+                if(rankID == 0)
+                    printf("Cell width must be a positive integer dividing %d\n", FULL_WIDTH);
+
+                MPI_Finalize();
+                return 1;
+            }
+
+            break;
+        case 'J':
+            bench_path = optarg;
+            break;
+        case 'm':
+            mpiio = 1;
+            break;
+        case 'p':
+            periodic = 1;
+            break;
+        case 'r':
+            symmetric = 1;
+            break;
+        case 'T':
+            trace_path = optarg;
+            break;
+        case 'v':
+            viewport = optarg;
+            break;
+        default:
+            MPI_Finalize();
+            return 1;
+        }
+    }
+
+    /** Every rank that colours pixels needs the palette, counts run to MAX_ITER + 1 */
+    if(palette_select(palette, MAX_ITER + 1) != 0) {
+        if(rankID == 0)
+            printf("Unknown palette %s\n", palette);
+
+        MPI_Finalize();
+        return 1;
+    }
 
     /** Hardcode constant */
-    c.re = -.4;
-    c.im = .6;
+    c.re = C_RE;
+    c.im = C_IM;
+
+    /** Pixels mapped between -1 and 1 */
+    plane.c = c;
+    plane.max_iterations = MAX_ITER;
+    plane.exponent = 2;
+    plane.width = plane.height = FULL_WIDTH;
+    plane.transpose = 0;
+    plane.centre.re = plane.centre.im = 0;
+    plane.centre_lo.re = plane.centre_lo.im = 0;
+    plane.scale = 1;
+    plane.orbit = NULL;
+
+    if(viewport && zoom_viewport(viewport, &plane) != 0) {
+        if(rankID == 0)
+            printf("Viewport must be centre_re,centre_im,scale with a positive scale\n");
+
+        MPI_Finalize();
+        return 1;
+    }
 
-    send_arr = (int  *)malloc(CHUNK_WIDTH * CHUNK_WIDTH * sizeof(int));
+    /** Periodicity checking, tolerance tied to pixel spacing */
+    if(periodic)
+        kernel_periodicity(KERNEL_PERIOD_TOL(2.0 * plane.scale / FULL_WIDTH));
+
+    /** Too deep for double, every rank iterates around its own copy of a
+    reference orbit */
+    if(zoom_deep(&plane)) {
+        if(zoom_orbit(&orbit, &plane) != 0) {
+            printf("Proc: %d \tCould not allocate reference orbit\n", rankID);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        plane.orbit = &orbit;
 
-    /** Master process create full array and initial file IO */
-    if(rankID == 0) {
         if(rankID == 0)
-            printf("Runtime Stats:\n\tNum Procs:\t%d\n\n", numProcs);
+            printf("\tDeep zoom, reference orbit of %d iterations\n", orbit.length);
+    }
+
+    /** Symmetric images only compute the chunk rows down to just past the
+    centre, the master mirrors the rest into its image */
+    if(symmetric) {
+        if(mpiio) {
+            if(rankID == 0)
+                printf("Mirroring needs the whole image on the master, it cannot be combined with MPI-IO\n");
+
+            MPI_Finalize();
+            return 1;
+        }
 
-        full_arr = (int  *)malloc(FULL_WIDTH * FULL_WIDTH * sizeof(int));
+        if(plane_symmetric(&plane)) {
+            rows = (plane_half(FULL_WIDTH) + CHUNK_WIDTH - 1) / CHUNK_WIDTH * CHUNK_WIDTH;
+            NUM_CHUNKS = (rows / CHUNK_WIDTH) * (FULL_WIDTH / CHUNK_WIDTH);
+        }
+    }
+
+    /** Cells take the place of chunks, so the rows computed are whole rows
+    of cells */
+    if(cell) {
+        rows = (rows + cell - 1) / cell * cell;
+        ncells = (rows / cell) * (FULL_WIDTH / cell);
+    }
+
+    /** Every chunk this rank computes is kept until the end, its pixels in the
+    order they appear in the image: each chunk row's chunks side by side */
+    MY_CHUNKS = NUM_CHUNKS > rankID ? (NUM_CHUNKS - 1 - rankID) / numProcs + 1 : 0;
+    pixel_type_create(&PIXEL);
+
+    if(rankID == 0)
+        printf("Runtime Stats:\n\tNum Procs:\t%d\n\n", numProcs);
+
+    /** With MPI-IO every rank writes its own pixels, rank 0 never holds the
+    whole image */
+    if(mpiio) {
+        if(ppm_open(&ppm, MPI_COMM_WORLD, "image_out.ppm", FULL_WIDTH, FULL_WIDTH) != MPI_SUCCESS) {
+            if(rankID == 0)
+                printf("Could not open handle to image\n");
+
+            MPI_Finalize();
+            return 1;
+        }
+    }
+    /** Master process create full array and initial file IO */
+    else if(rankID == 0) {
+        if(frame_create(&full_arr, FULL_WIDTH, FULL_WIDTH, sizeof(pixel_t)) != 0) {
+            printf("Could not allocate image\n");
+            return 1;
+        }
 
-        for(i = 0; i < FULL_WIDTH * FULL_WIDTH; i++)
-            full_arr[i] = 5; // RANDOM VALUE
+        memset(full_arr.data, 0, (size_t)FULL_WIDTH * full_arr.pitch * sizeof(pixel_t));
 
         img = fopen("image_out.ppm", "w");
 
@@ -97,91 +274,285 @@ int main(int argc, char* argv[])
         fprintf(img, "P6\n%d %d 255\n", FULL_WIDTH, FULL_WIDTH);
     }
 
+    /** Benchmarked ranks start together, so the master's time covers
+    everybody's work */
+    if(bench_path)
+        MPI_Barrier(MPI_COMM_WORLD);
+
+    /** Every rank computes and sends on its one thread */
+    trace = trace_create(MPI_COMM_WORLD, 1, trace_path != NULL);
+
     /** Start MPI timer */
     start = MPI_Wtime();
 
+    /** Cells rather than chunks are shared out, by what a coarse render of
+    the image says each costs. Every rank works the assignment out for
+    itself from the same costs, so nothing else is sent */
+    if(cell) {
+        cost = (long long *)malloc(ncells * sizeof(long long));
+        owner = (int *)malloc(ncells * sizeof(int));
+        cells = (int *)malloc(ncells * sizeof(int));
+
+        balance_costs(&plane, cell, cell < PREPASS_SAMPLES ? cell : PREPASS_SAMPLES, rows / cell, MPI_COMM_WORLD, cost);
+        estimate = balance_assign(cost, ncells, numProcs, owner);
+        free(cost);
+
+        for(i = 0; i < ncells; i++)
+            if(owner[i] == rankID)
+                cells[MY_CELLS++] = i;
+
+        prepass_time = MPI_Wtime() - start;
+        trace_event(trace, TRACE_COMPUTE, start, -1, 0, 0);
+        npixels = (size_t)MY_CELLS * cell * cell;
+    } else
+        npixels = (size_t)MY_CHUNKS * CHUNK_WIDTH * CHUNK_WIDTH;
+
+    send_arr = (pixel_t *)malloc((npixels ? npixels : 1) * sizeof(pixel_t));
+
+    /** Each cell in one go, in the order they are held */
+    if(cell) {
+        cell_counts = (int *)malloc((size_t)cell * cell * sizeof(int));
+
+        for(k = 0; k < MY_CELLS; k++) {
+            Y_start = cells[k] / (FULL_WIDTH / cell) * cell;
+            X_start = cells[k] % (FULL_WIDTH / cell) * cell;
+            row_since = MPI_Wtime();
+            row_before = work.iterations;
+
+            since = bench_now();
+            kernel_tile(&plane, Y_start, X_start, cell, cell, cell_counts, cell);
+            bench_add(&work, since, cell_counts, cell, cell, cell);
+
+            /** Report iterations + 1 */
+            for(i = 0; i < cell * cell; i++)
+                cell_counts[i]++;
+
+            pixel_pack(cell_counts, cell, cell, cell, send_arr + (size_t)k * cell * cell, cell);
+            trace_event(trace, TRACE_COMPUTE, row_since, cells[k], work.iterations - row_before, 0);
+        }
+
+        free(cell_counts);
+        MY_CHUNKS = 0;
+    }
+
     /** Grid-stride loop */
-    for(LOOPCOUNT = 0; LOOPCOUNT < NUM_CHUNKS; LOOPCOUNT += numProcs) {
+    for(LOOPCOUNT = 0; LOOPCOUNT < MY_CHUNKS; LOOPCOUNT++) {
         /** Work out chunk info */
-        CUR_CHUNK = LOOPCOUNT + rankID;
-        CHUNK_SQUARED = CHUNK_WIDTH * CHUNK_WIDTH;
-
-        if(CUR_CHUNK > NUM_CHUNKS)
-            CHUNK_SQUARED = 0;
+        CUR_CHUNK = LOOPCOUNT * numProcs + rankID;
 
 #ifdef DEBUG
-        printf("Proc %d\tJob: Process [# %d]\n", rankID, CUR_CHUNK, CHUNK_SQUARED);
+        printf("Proc %d\tJob: Process [# %d]\n", rankID, CUR_CHUNK);
 #endif
 
         /** Pixel co-ord based on chunk number */
         pixel_YX[0] = (CUR_CHUNK / (FULL_WIDTH / CHUNK_WIDTH)) * CHUNK_WIDTH;
         pixel_YX[1] = (CUR_CHUNK % (FULL_WIDTH / CHUNK_WIDTH)) * CHUNK_WIDTH;
 
-        /** Iterate over equation for each pixel in chunk */
-        for(i = 0; i < CHUNK_WIDTH; i++) {
-            for(j = 0; j < CHUNK_WIDTH; j++) {
-                send_arr[(i * CHUNK_WIDTH) + j] = iterator(
-                                                      c,
-                                                      -(((pixel_YX[0] + i) - (FULL_WIDTH / 2)) / (double) FULL_WIDTH) * 2,
-                                                      (((pixel_YX[1] + j) - (FULL_WIDTH / 2)) / (double) FULL_WIDTH) * 2
-                                                  );
+        /** New chunk row, starts after the last one's pixels; chunks are
+        traced a row at a time, there are too many to trace one by one */
+        if(pixel_YX[0] / CHUNK_WIDTH != row) {
+            if(row >= 0) {
+                row_base += (size_t)row_n * CHUNK_WIDTH * CHUNK_WIDTH;
+                trace_event(trace, TRACE_COMPUTE, row_since, row, work.iterations - row_before, 0);
             }
+
+            row = pixel_YX[0] / CHUNK_WIDTH;
+            rank_row_chunks(rankID, numProcs, row, &row_col, &row_n);
+            row_since = MPI_Wtime();
+            row_before = work.iterations;
+        }
+
+        /** Iterate over equation for each pixel in chunk */
+        since = bench_now();
+        kernel_tile(&plane, pixel_YX[0], pixel_YX[1], CHUNK_WIDTH, CHUNK_WIDTH, counts, CHUNK_WIDTH);
+        bench_add(&work, since, counts, CHUNK_WIDTH, CHUNK_WIDTH, CHUNK_WIDTH);
+
+        /** Report iterations + 1 */
+        for(i = 0; i < CHUNK_WIDTH * CHUNK_WIDTH; i++)
+            counts[i]++;
+
+        pixel_pack(counts, CHUNK_WIDTH, CHUNK_WIDTH, CHUNK_WIDTH,
+                   send_arr + row_base + (pixel_YX[1] / CHUNK_WIDTH - row_col) / numProcs * CHUNK_WIDTH,
+                   row_n * CHUNK_WIDTH);
+    }
+
+    if(row >= 0)
+        trace_event(trace, TRACE_COMPUTE, row_since, row, work.iterations - row_before, 0);
+
+    if(mpiio) {
+        /** End elapsed time */
+        stop = MPI_Wtime();
+        elapsed_time = stop - start;
+
+        /** Colourize in place of the counts and write them where they belong */
+        rgb = (unsigned char *)malloc(npixels * 3 + 1);
+        pixel_plot_row(send_arr, rgb, npixels);
+
+        MPI_Type_contiguous(3, MPI_BYTE, &RGB);
+
+        if(cell)
+            ppm_tiles_types(&ppm, cells, MY_CELLS, cell, &memtype, &RANK_PIXELS);
+        else {
+            MPI_Type_contiguous(npixels, RGB, &memtype);
+            MPI_Type_commit(&memtype);
+            RANK_PIXELS = rank_rows_type(rankID, numProcs, RGB, FULL_WIDTH, FULL_WIDTH);
         }
 
-        /** Calculate displacements */
+        ppm_write(&ppm, rgb, memtype, RANK_PIXELS);
+        ppm_close(&ppm);
+
+        write_time = MPI_Wtime() - stop;
+        trace_event(trace, TRACE_WRITE, stop, -1, 0, 0);
+
         if(rankID == 0) {
-            for(i = 0; i < numProcs; i++) {
-                if((disp + i) % (FULL_WIDTH / CHUNK_WIDTH) == 0 && disp + i != 0)
-                    disp += (FULL_WIDTH / CHUNK_WIDTH) * (CHUNK_WIDTH - 1);
+            printf("Algorithm completed for,\n\t%d * %d pixels\n\t%d maximum iterations\n\t\tin %f seconds.\n",
+                   FULL_WIDTH, FULL_WIDTH,
+                   MAX_ITER,
+                   elapsed_time);
+            printf("\tImage written with MPI-IO in %f seconds.\n", write_time);
+        }
 
-                displs[i] = disp + i;
-                sendcounts[i] = CUR_CHUNK + i > NUM_CHUNKS ? 0 : CHUNK_WIDTH * CHUNK_WIDTH;
-            }
+        MPI_Type_free(&RANK_PIXELS);
+        MPI_Type_free(&memtype);
+        MPI_Type_free(&RGB);
+        free(rgb);
+    } else {
+        /** Master receives every rank's pixels in one message, placed directly
+        into full_arr by a datatype describing that rank's share of the grid */
+        if(rankID == 0) {
+            recv_reqs = (MPI_Request *)malloc(numProcs * sizeof(MPI_Request));
 
-            disp += numProcs;
+            for(i = 0; i < numProcs; i++) {
+                if(cell)
+                    RANK_PIXELS = rank_cells_type(owner, ncells, i, cell, PIXEL, full_arr.pitch);
+                else
+                    RANK_PIXELS = rank_rows_type(i, numProcs, PIXEL, full_arr.pitch, rows);
+
+                MPI_Irecv(
+                    full_arr.data,
+                    1,
+                    RANK_PIXELS,
+                    i,
+                    0,
+                    MPI_COMM_WORLD,
+                    &recv_reqs[i]
+                );
+
+                /** Freed once the pending receive is done with it */
+                MPI_Type_free(&RANK_PIXELS);
+            }
         }
 
         /** Group comms */
-        MPI_Gatherv(
+        MPI_Isend(
             send_arr,
-            CHUNK_SQUARED,
-            MPI_INT,
-            full_arr,
-            sendcounts,
-            displs,
-            CHUNKxCHUNK_RE,
+            npixels,
+            PIXEL,
             0,
-            MPI_COMM_WORLD
+            0,
+            MPI_COMM_WORLD,
+            &request
         );
-#ifdef DEBUG
 
-        if(rankID == 0)
-            printf("Proc: MA\tJob: Gather [# %d]\n", CUR_CHUNK / numProcs);
+        if(rankID == 0) {
+            row_since = MPI_Wtime();
+            MPI_Waitall(numProcs, recv_reqs, MPI_STATUSES_IGNORE);
+            trace_event(trace, TRACE_WAIT, row_since, -1, 0, 0);
+            free(recv_reqs);
 
+#ifdef DEBUG
+            printf("Proc: MA\tJob: Gathered\n");
 #endif
+
+            /** Bottom rows mirror the top ones, bar column 0 which has no mirror */
+            if(rows < FULL_WIDTH) {
+                column = (int *)malloc((FULL_WIDTH - rows) * sizeof(int));
+
+                kernel_tile(&plane, rows, 0, FULL_WIDTH - rows, 1, column, 1);
+
+                for(i = 0; i < FULL_WIDTH - rows; i++)
+                    column[i]++;
+
+                pixel_pack(column, 1, FULL_WIDTH - rows, 1, (pixel_t*) frame_at(&full_arr, rows, 0), full_arr.pitch);
+                frame_mirror(&full_arr, rows);
+
+                free(column);
+            }
+        }
+
+        row_since = MPI_Wtime();
+        MPI_Wait(&request, &status);
+        trace_event(trace, TRACE_SEND, row_since, -1, 0, (long)(npixels * sizeof(pixel_t)));
+
+        /** End elapsed time */
+        stop = MPI_Wtime();
+        elapsed_time = stop - start;
+
+        /** Master process plot the image */
+        if(rankID == 0) {
+            printf("Algorithm completed for,\n\t%d * %d pixels\n\t%d maximum iterations\n\t\tin %f seconds.\n",
+                   FULL_WIDTH, FULL_WIDTH,
+                   MAX_ITER,
+                   elapsed_time);
+
+            if(rows < FULL_WIDTH)
+                printf("\t%d of %d rows mirrored\n", FULL_WIDTH - rows, FULL_WIDTH);
+
+            since = MPI_Wtime();
+            palette_frame(&full_arr, img, NULL);
+
+            fclose(img);
+            write_time = MPI_Wtime() - since;
+            trace_event(trace, TRACE_WRITE, since, -1, 0, 0);
+            frame_destroy(&full_arr);
+        }
+    }
+
+    if(cell && rankID == 0)
+        printf("\t%d cells of %d * %d pixels shared out in %f seconds, estimated imbalance %f\n",
+               ncells, cell, cell, prepass_time, estimate);
+
+    free(owner);
+    free(cells);
+
+    /** Every rank computes on its one thread, the rest of its time in the
+    computation went on handing its pixels over */
+    if(bench_path) {
+        record.driver = "CM";
+        record.width = record.height = FULL_WIDTH;
+        record.frames = 1;
+        record.chunk = cell ? cell : CHUNK_WIDTH;
+        record.max_iterations = MAX_ITER;
+        record.c = c;
+        record.ranks = numProcs;
+        record.threads = 1;
+        record.wall = elapsed_time + write_time;
+        record.compute = elapsed_time;
+        record.io = write_time;
+
+        if(bench_gather(&record, bench_path, MPI_COMM_WORLD, &work, 1, 1, elapsed_time) != 0)
+            printf("Could not write benchmark record to %s\n", bench_path);
     }
 
-    /** End elapsed time */
-    stop = MPI_Wtime();
-    elapsed_time = stop - start;
+    /** Where every rank's time went */
+    if(trace_finish(trace, 1, trace_names, trace_path, MPI_COMM_WORLD) != 0)
+        printf("Could not write trace to %s\n", trace_path);
 
-    /** Master process plot the image */
-    if(rankID == 0) {
-        printf("Algorithm completed for,\n\t%d * %d pixels\n\t%d maximum iterations\n\t\tin %f seconds.\n",
-               FULL_WIDTH, FULL_WIDTH,
-               MAX_ITER,
-               elapsed_time);
+    /** Pixels moved back to the start of the reference orbit */
+    if(plane.orbit) {
+        MPI_Reduce(&orbit.rebases, &total_rebases, 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
 
-        plot(full_arr, img);
+        if(rankID == 0)
+            printf("\t%ld rebases onto the reference orbit\n", total_rebases);
 
-        fclose(img);
-        free(full_arr);
+        zoom_release(&orbit);
     }
 
     free(send_arr);
+    MPI_Type_free(&PIXEL);
+    palette_release();
 
     /** MPI clean-up */
-    MPI_Type_free(&CHUNKxCHUNK_RE);
     MPI_Finalize();
     fflush(stdout);
 
@@ -190,51 +561,89 @@ int main(int argc, char* argv[])
 }
 
 /**
-Iterating function
+Row share function
 */
-long iterator(Complex c, double im, double re)
+void rank_row_chunks(int rank, int numProcs, int row, int* col, int* n)
 {
-    Complex z;
-    long itCount = 0;
+    int per_row = FULL_WIDTH / CHUNK_WIDTH;
 
-    z.re = re;
-    z.im = im;
+    *col = (int)((rank - (long)row * per_row) % numProcs);
 
-    for(; itCount < MAX_ITER; itCount++) {
-        z = cmplx_add(cmplx_squared(z), c);
+    if(*col < 0)
+        *col += numProcs;
 
-        if(cmplx_magnitude(z) > 4)
-            break;
+    *n = *col < per_row ? (per_row - 1 - *col) / numProcs + 1 : 0;
+}
+
+/**
+Per-rank placement type
+*/
+MPI_Datatype rank_rows_type(int rank, int numProcs, MPI_Datatype pixel, int pitch, int height)
+{
+    int y, col, n, rows = 0;
+    int per_row = FULL_WIDTH / CHUNK_WIDTH;
+    int lens[2];
+    int *blocklens = (int *)malloc(FULL_WIDTH * sizeof(int));
+    MPI_Aint *displs = (MPI_Aint *)malloc(FULL_WIDTH * sizeof(MPI_Aint));
+    MPI_Datatype *types = (MPI_Datatype *)malloc(FULL_WIDTH * sizeof(MPI_Datatype));
+    MPI_Datatype vecs[2], rank_type;
+    MPI_Aint lb, size;
+
+    MPI_Type_get_extent(pixel, &lb, &size);
+
+    /** A chunk row holds either the floor or the ceiling of per_row / numProcs
+    of each rank's chunks, 'numProcs' chunks apart */
+    lens[0] = per_row / numProcs;
+    lens[1] = lens[0] + 1;
+    MPI_Type_vector(lens[0], CHUNK_WIDTH, numProcs * CHUNK_WIDTH, pixel, &vecs[0]);
+    MPI_Type_vector(lens[1], CHUNK_WIDTH, numProcs * CHUNK_WIDTH, pixel, &vecs[1]);
+
+    for(y = 0; y < height; y++) {
+        rank_row_chunks(rank, numProcs, y / CHUNK_WIDTH, &col, &n);
+
+        if(n == 0)
+            continue;
+
+        blocklens[rows] = 1;
+        displs[rows] = ((MPI_Aint)y * pitch + (MPI_Aint)col * CHUNK_WIDTH) * size;
+        types[rows] = n == lens[0] ? vecs[0] : vecs[1];
+        rows++;
     }
 
-    return itCount + 1;
+    MPI_Type_create_struct(rows, blocklens, displs, types, &rank_type);
+    MPI_Type_commit(&rank_type);
+
+    MPI_Type_free(&vecs[0]);
+    MPI_Type_free(&vecs[1]);
+    free(blocklens);
+    free(displs);
+    free(types);
+
+    return rank_type;
 }
 
 /**
-Function which calculates the pixel values from the square array
+Per-rank cell placement type
 */
-void plot(int* full_arr, FILE* img)
+MPI_Datatype rank_cells_type(const int* owner, int ncells, int rank, int cell, MPI_Datatype pixel, int pitch)
 {
-    int i, j;
-    unsigned char line[3 * FULL_WIDTH];
-
-    for(i = 0; i < FULL_WIDTH; i++) {
-        for(j = 0; j < FULL_WIDTH; j++) {
-            if (*(full_arr + j + (i * FULL_WIDTH)) <= 63) {
-                line[3 * j] = 255;
-                line[3 * j + 1] = line[3 * j + 2] =
-                                      255 - 4 * *(full_arr + j + (i * FULL_WIDTH));
-            } else {
-                line[3 * j] = 255;
-                line[3 * j + 1] = *(full_arr + j + (i * FULL_WIDTH)) - 63;
-                line[3 * j + 2] = 0;
-            }
+    int i, n = 0, per_row = FULL_WIDTH / cell;
+    MPI_Aint *displs = (MPI_Aint *)malloc((ncells ? ncells : 1) * sizeof(MPI_Aint));
+    MPI_Datatype block, rank_type;
+    MPI_Aint lb, size;
 
-            if (*(full_arr + j + (i * FULL_WIDTH)) == 320)
-                line[3 * j] = line[3 * j + 1] = line[3 * j + 2] = 255;
-        }
+    MPI_Type_get_extent(pixel, &lb, &size);
+    MPI_Type_vector(cell, cell, pitch, pixel, &block);
 
-        fwrite(line, 1, 3 * FULL_WIDTH, img);
-    }
-}
+    for(i = 0; i < ncells; i++)
+        if(owner[i] == rank)
+            displs[n++] = ((MPI_Aint)(i / per_row) * cell * pitch + (MPI_Aint)(i % per_row) * cell) * size;
+
+    MPI_Type_create_hindexed_block(n, 1, displs, block, &rank_type);
+    MPI_Type_commit(&rank_type);
 
+    MPI_Type_free(&block);
+    free(displs);
+
+    return rank_type;
+}
@@ -1,6 +1,6 @@
 /***************************************************************************
  * Filename: fracfun_DYNAMIC.c
- * Usage: ./bin/fracfun_DYNAMIC [max_iterations] [real_part] [imaginary_part]
+ * Usage: ./bin/fracfun_DYNAMIC [-b | -g step | -m] [-C dir] [-c palette] [-d exponent] [-J file] [-p] [-r] [-s] [-t threads] [-v centre_re,centre_im,scale] [-z state] [max_iterations] [real_part] [imaginary_part]
  *			[Optional: [X co-ord] [Y co-ord]]
  * Author: Benjamin J Carrington
  *
@@ -10,19 +10,100 @@
 #include <stdlib.h>
 #include <math.h>
 #include <time.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "cmplx.h"
+#include "kernel.h"
+#include "palette.h"
+#include "tile.h"
+#include "sched.h"
+#include "frame.h"
+#include "mapped.h"
+#include "refine.h"
+#include "cache.h"
+#include "state.h"
+#include "zoom.h"
+#include "bench.h"
 
 /**
-Takes the information of 'image', calculates colour intensity per pixel, and
-writes to 'img' handle
+Bands of colourized rows in flight when streaming: 'slots' buffers filled in
+turn by the compute threads and written out in order by the writer thread.
+'filled' and 'written' count bands handed to and finished by the writer
 */
-void plot(int** image, FILE* img, int szX, int szY);
+#define STREAM_BANDS 3
+
+typedef struct BandRing
+{
+    unsigned char* bands[STREAM_BANDS];
+    size_t sizes[STREAM_BANDS];
+    int filled, written, done;
+    FILE* img;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} BandRing;
+
+/**
+Work shared by the tile tasks; each thread has its own tile buffer and count
+of pixels filled by subdivision. Tiles are computed straight into 'image',
+or when streaming are colourized into 'band', which holds the rows from 'y0' on
+(in place in the file when it is mapped). Rows from 'rows' on are not
+computed, they mirror the rows above. Tiles found in 'cache' (if not NULL)
+are not computed, those computed are added to it. A progressive render
+instead runs pass 'step' over bands of TILE_WIDTH rows of 'image', and a
+render carried on from a state file runs the bands of 'state'. Each thread
+adds the time it spends computing to its own 'work'
+*/
+typedef struct TileJob
+{
+    const Plane* plane;
+    Frame* image;
+    unsigned char* band;
+    int y0;
+    int rows;
+    int tilesX;
+    int subdivide;
+    int step, first;
+    int** tile_bufs;
+    long* skipped;
+    BenchWork* work;
+    TileCache* cache;
+    IterState* state;
+} TileJob;
+
+/**
+Computes tile number 'task' (counted from row 'y0') of the image
+*/
+void tile_task(void* arg, int task, int thread);
+
+/**
+Computes band 'task' of the current pass of a progressive render
+*/
+void refine_task(void* arg, int task, int thread);
+
+/**
+Carries band 'task' of the state on to the new cap
+*/
+void state_task(void* arg, int task, int thread);
+
+/**
+Writes 'image' as it stands after pass 'step' of a progressive render to
+'path', replacing it in one rename so it is never seen half written
+*/
+int refine_write(const Frame* image, int step, const char* path);
+
+/**
+Writer thread: writes bands out of the ring in order until it is done
+*/
+void* band_writer(void* arg);
 
 /**
-Performs the equation of z = z^2 + c; returns number of iterations before
-point falls outside the circle
+Fills rows 'from' to 'to' - 1 of the current band by mirroring the rows above
+them (see plane_mirror()). A mirrored row above the band is read into
+'scratch' from 'fd' ('header' bytes in) when streaming, or is still in place
+above the band when the file is mapped ('fd' < 0). Column 0 of an even width
+has no mirror and is computed
 */
-int iterator(Complex c, int max_iterations, double im, double re);
+void band_mirror(TileJob* job, int from, int to, int fd, long header, unsigned char* scratch);
 
 /**
 Main function
@@ -30,31 +111,126 @@ Main function
 int main(int argc, char* argv[])
 {
     /** Variable declarations */
-    int **image;
+    Frame image;
     int szX = 500, szY = 500;
-    int max_iterations;
-    int i, j;
+    int max_iterations, exponent = 2, periodic = 0, subdivide = 0, nthreads = 1, stream = 0, mapped = 0;
+    int progressive = 0, step;
+    int i, opt, nargs, tilesY, rows, symmetric = 0, header = 0;
+    long skipped = 0, steals = 0, hits, lookups;
     FILE *img;
     Complex c;
-    char *itEnd_p, *imEnd_p, *reEnd_p, *szXEnd_p, *szYEnd_p;
-    clock_t start, finish;
-    float elapsed_time;
+    Plane plane;
+    TileJob job;
+    SchedPool* pool;
+    BandRing ring;
+    unsigned char* scratch;
+    MappedPpm map;
+    IterState state;
+    Orbit orbit;
+    pthread_t writer;
+    const char* palette = "classic";
+    const char* cache_dir = NULL;
+    const char* state_path = NULL;
+    const char* viewport = NULL;
+    const char* bench_path = NULL;
+    char *itEnd_p, *imEnd_p, *reEnd_p, *szXEnd_p, *szYEnd_p, *optEnd_p;
+    struct timespec start, finish;
+    float elapsed_time, plot_time = 0;
+    BenchRecord record;
+    double* busy;
+
+    /** Options section */
+    while((opt = getopt(argc, argv, "+bC:c:d:g:J:mprst:v:z:")) != -1) {
+        switch(opt) {
+        case 'b':
+            stream = 1;
+            break;
+        case 'C':
+            cache_dir = optarg;
+            break;
+        case 'c':
+            palette = optarg;
+            break;
+        case 'd':
+            exponent = strtol(optarg, &optEnd_p, 10);
+
+            if(*optEnd_p || exponent < 2) {
+                printf("Exponent must be an integer of at least 2\n");
+                return 1;
+            }
+
+            break;
+        case 'g':
+            progressive = strtol(optarg, &optEnd_p, 10);
+
+            if(*optEnd_p || progressive < 1 || (progressive & (progressive - 1))) {
+                printf("Progressive step must be a power of two\n");
+                return 1;
+            }
+
+            break;
+        case 'J':
+            bench_path = optarg;
+            break;
+        case 'm':
+            mapped = 1;
+            break;
+        case 'p':
+            periodic = 1;
+            break;
+        case 'r':
+            symmetric = 1;
+            break;
+        case 's':
+            subdivide = 1;
+            break;
+        case 't':
+            nthreads = strtol(optarg, &optEnd_p, 10);
+
+            if(*optEnd_p || nthreads < 1) {
+                printf("Thread count must be a positive integer\n");
+                return 1;
+            }
+
+            break;
+        case 'v':
+            viewport = optarg;
+            break;
+        case 'z':
+            state_path = optarg;
+            break;
+        default:
+            return 1;
+        }
+    }
+
+    nargs = argc - optind;
+
+    if(stream + mapped + !!progressive > 1) {
+        printf("Only one of -b, -g and -m can be given\n");
+        return 1;
+    }
+
+    if(state_path && stream + mapped + !!progressive > 0) {
+        printf("A state file needs the whole image in memory, it cannot be combined with -b, -g or -m\n");
+        return 1;
+    }
 
     /** Assure correct # of arguments */
-    if(argc != 4 && argc != 6) {
-        printf("Incorrect number of arguments\nUsage:\n\tfractal [max_iterations] [real_part] [imaginary_part]\n");
+    if(nargs != 3 && nargs != 5) {
+        printf("Incorrect number of arguments\nUsage:\n\tfractal [-b | -g step | -m] [-C dir] [-c palette] [-d exponent] [-J file] [-p] [-r] [-s] [-t threads] [-v centre_re,centre_im,scale] [-z state] [max_iterations] [real_part] [imaginary_part]\n");
         return 1;
     }
 
     /** User-input section */
-    max_iterations = strtol(argv[1], &itEnd_p, 10);
-    c.re = strtod(argv[2], &reEnd_p);
-    c.im = strtod(argv[3], &imEnd_p);
+    max_iterations = strtol(argv[optind], &itEnd_p, 10);
+    c.re = strtod(argv[optind + 1], &reEnd_p);
+    c.im = strtod(argv[optind + 2], &imEnd_p);
 
     /** If X and Y has been user-inputted, convert them to int and store */
-    if(argc == 6) {
-        szX = strtol(argv[4], &szXEnd_p, 10);
-        szY = strtol(argv[5], &szYEnd_p, 10);
+    if(nargs == 5) {
+        szX = strtol(argv[optind + 3], &szXEnd_p, 10);
+        szY = strtol(argv[optind + 4], &szYEnd_p, 10);
     }
 
     /** If unexpected characters are caught by conversions, end the program */
@@ -63,43 +239,258 @@ int main(int argc, char* argv[])
         return 1;
     }
 
-    /** Allocate memory for 'image' */
-    image = (int **)malloc(szX * sizeof(int *));
-
-    for(i = 0; i < szX; i++)
-        image[i] = (int *)malloc(szY * sizeof(int));
+    /** Every count up to max_iterations gets a colour */
+    if(palette_select(palette, max_iterations) != 0) {
+        printf("Unknown palette %s\n", palette);
+        return 1;
+    }
 
-    /** Open 'img' handle as 'overwrite if exists' */
-    img = fopen("image_out.ppm", "w");
+    /** Allocate memory for 'image', or when streaming only for the ring of
+    bands, one row of tiles each; a mapped file needs neither */
+    if(mapped) {
+        if(mapped_open(&map, "image_out.ppm", szX, szY) != 0) {
+            printf("Could not map output file. Exiting\n");
+            return 1;
+        }
+    } else if(stream) {
+        for(i = 0; i < STREAM_BANDS; i++)
+            ring.bands[i] = (unsigned char *)malloc((size_t) 3 * szX * TILE_WIDTH);
+
+        ring.filled = ring.written = ring.done = 0;
+        pthread_mutex_init(&ring.lock, NULL);
+        pthread_cond_init(&ring.cond, NULL);
+    } else if(frame_create(&image, szX, szY, sizeof(int)) != 0) {
+        printf("Could not allocate image\n");
+        return 1;
+    }
 
-    if(img == NULL) {
-        printf("Could not open output file. Exiting\n");
+    /** Pixels mapped between -1 and 1 unless a viewport is given, Y on the
+    real axis, z = z^exponent + c */
+    plane.c = c;
+    plane.max_iterations = max_iterations;
+    plane.exponent = exponent;
+    plane.width = szX;
+    plane.height = szY;
+    plane.transpose = 1;
+    plane.centre.re = plane.centre.im = 0;
+    plane.centre_lo.re = plane.centre_lo.im = 0;
+    plane.scale = 1;
+    plane.orbit = NULL;
+
+    if(viewport && zoom_viewport(viewport, &plane) != 0) {
+        printf("Viewport must be centre_re,centre_im,scale with a positive scale\n");
         return 1;
     }
 
-    /** Print file signature to handle */
-    fprintf(img, "P6\n%d %d 255\n", szX, szY);
+    /** Periodicity checking, tolerance tied to the smaller pixel spacing */
+    if(periodic)
+        kernel_periodicity(KERNEL_PERIOD_TOL(2.0 * plane.scale / (szX > szY ? szX : szY)));
+
+    /** Too deep for double, pixels are iterated as offsets from one
+    reference orbit computed in double-double */
+    if(zoom_deep(&plane)) {
+        if(exponent != 2 || progressive || state_path) {
+            printf("Deep zooms only render z = z^2 + c, and cannot be combined with -g or -z\n");
+            return 1;
+        }
+
+        if(zoom_orbit(&orbit, &plane) != 0) {
+            printf("Could not allocate reference orbit\n");
+            return 1;
+        }
 
-    if(img == NULL) {
-        printf("Could not open image file\n");
+        plane.orbit = &orbit;
+        printf("\tDeep zoom, reference orbit of %d iterations\n", orbit.length);
+    }
+
+    /** Only the top half needs computing when the set is symmetric */
+    if(symmetric && !plane_symmetric(&plane)) {
+        printf("Only even exponents centred on 0 are symmetric, computing the whole image\n");
+        symmetric = 0;
+    }
+
+    if(symmetric && progressive) {
+        printf("Progressive renders compute the whole image, not mirroring\n");
+        symmetric = 0;
+    }
+
+    /** Every pixel has to be iterated for its z to be kept */
+    if(state_path && symmetric) {
+        printf("Renders with a state file compute the whole image, not mirroring\n");
+        symmetric = 0;
+    }
+
+    if(state_path && subdivide) {
+        printf("Renders with a state file iterate every pixel, not subdividing\n");
+        subdivide = 0;
+    }
+
+    /** Tiles of earlier renders of the region are reused */
+    job.cache = NULL;
+    job.state = NULL;
+
+    if(cache_dir && progressive)
+        printf("Progressive renders do not go through the tile cache\n");
+    else if(cache_dir && state_path)
+        printf("Renders with a state file do not go through the tile cache\n");
+    else if(cache_dir && (job.cache = cache_open(cache_dir, CACHE_MAX_BYTES)) == NULL) {
+        printf("Could not open tile cache %s\n", cache_dir);
         return 1;
     }
 
-    /** Begin the clock */
-    start = clock();
+    /** Image is split into TILE_WIDTH tiles, one task each */
+    job.plane = &plane;
+    job.image = stream || mapped ? NULL : &image;
+    job.band = NULL;
+    job.y0 = 0;
+    job.rows = symmetric ? plane_half(szY) : szY;
+    job.tilesX = (szX + TILE_WIDTH - 1) / TILE_WIDTH;
+    job.subdivide = subdivide;
+    job.tile_bufs = (int **)malloc(nthreads * sizeof(int *));
+    job.skipped = (long *)calloc(nthreads, sizeof(long));
+    job.work = (BenchWork *)calloc(nthreads, sizeof(BenchWork));
+    tilesY = (szY + TILE_WIDTH - 1) / TILE_WIDTH;
+    scratch = (unsigned char *)malloc((size_t) 3 * szX);
+
+    for(i = 0; i < nthreads; i++)
+        job.tile_bufs[i] = (int *)malloc(TILE_WIDTH * TILE_WIDTH * sizeof(int));
+
+    /** Open 'img' handle as 'overwrite if exists'; progressive passes are
+    each written out whole */
+    if(!mapped && !progressive) {
+        /** Read back as well when mirroring while streaming */
+        img = fopen("image_out.ppm", "w+");
+
+        if(img == NULL) {
+            printf("Could not open output file. Exiting\n");
+            return 1;
+        }
+
+        /** Print file signature to handle */
+        header = fprintf(img, "P6\n%d %d 255\n", szX, szY);
+    }
+
+    /** Pixels that had not escaped under a lower cap carry on from where
+    they stopped, every other pixel already has its count */
+    if(state_path) {
+        i = state_load(&state, state_path, &plane, &image);
 
-    for(i = 0; i < szY; i++) {
-        for(j = 0; j < szX; j++) {
-            /** Call iterator function with each pixel (mapped between -1 and 1) */
-            image[j][i] = iterator(c, max_iterations, \
-                                   -(((i - (szY / 2)) / (double) szY) * 2),
-                                   ((j - (szX / 2)) / (double) szX) * 2);
+        if(i < 0) {
+            printf("Could not allocate iteration state\n");
+            return 1;
         }
+
+        if(i > 0)
+            printf("\tCarrying on from %d iterations\n", state.max_iterations);
+
+        job.state = &state;
     }
 
+    /** Begin the clock (wall time, CPU time would add up across threads) */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    /** Compute every tile on 'nthreads' threads */
+    pool = sched_create(nthreads);
+
+    if(stream) {
+        /** One row of tiles at a time, written out by 'writer' while the
+        next ones are computed */
+        ring.img = img;
+        pthread_create(&writer, NULL, band_writer, &ring);
+
+        for(i = 0; i < tilesY; i++) {
+            pthread_mutex_lock(&ring.lock);
+
+            while(i - ring.written >= STREAM_BANDS)
+                pthread_cond_wait(&ring.cond, &ring.lock);
+
+            pthread_mutex_unlock(&ring.lock);
+
+            job.y0 = i * TILE_WIDTH;
+            job.band = ring.bands[i % STREAM_BANDS];
+            rows = szY - job.y0 < TILE_WIDTH ? szY - job.y0 : TILE_WIDTH;
+
+            if(job.y0 < job.rows)
+                steals += sched_run(pool, job.tilesX, tile_task, &job);
+
+            /** Mirrored rows come from bands already in the file */
+            if(job.y0 + rows > job.rows) {
+                pthread_mutex_lock(&ring.lock);
+
+                while(ring.written < i)
+                    pthread_cond_wait(&ring.cond, &ring.lock);
+
+                pthread_mutex_unlock(&ring.lock);
+
+                band_mirror(&job, job.y0 > job.rows ? job.y0 : job.rows, job.y0 + rows,
+                            fileno(img), header, scratch);
+            }
+
+            pthread_mutex_lock(&ring.lock);
+            ring.sizes[i % STREAM_BANDS] = (size_t) 3 * szX * rows;
+            ring.filled++;
+            pthread_cond_broadcast(&ring.cond);
+            pthread_mutex_unlock(&ring.lock);
+        }
+
+        pthread_mutex_lock(&ring.lock);
+        ring.done = 1;
+        pthread_cond_broadcast(&ring.cond);
+        pthread_mutex_unlock(&ring.lock);
+
+        pthread_join(writer, NULL);
+    } else if(mapped) {
+        /** Tiles are coloured straight into the file, one row of tiles at a
+        time so each can be handed to writeback once it is done */
+        for(i = 0; i < tilesY; i++) {
+            job.y0 = i * TILE_WIDTH;
+            job.band = mapped_at(&map, job.y0, 0);
+            rows = szY - job.y0 < TILE_WIDTH ? szY - job.y0 : TILE_WIDTH;
+
+            if(job.y0 < job.rows)
+                steals += sched_run(pool, job.tilesX, tile_task, &job);
+
+            if(job.y0 + rows > job.rows)
+                band_mirror(&job, job.y0 > job.rows ? job.y0 : job.rows, job.y0 + rows, -1, 0, NULL);
+            mapped_sync(&map, job.y0, rows, MS_ASYNC);
+        }
+    } else if(progressive) {
+        /** Coarsest grid first, every pass written out as a complete image
+        before the next one refines it */
+        for(step = progressive; step >= 1; step /= 2) {
+            job.step = step;
+            job.first = step == progressive;
+            steals += sched_run(pool, tilesY, refine_task, &job);
+
+            if(refine_write(&image, step, "image_out.ppm") != 0) {
+                printf("Could not write output file. Exiting\n");
+                return 1;
+            }
+
+            clock_gettime(CLOCK_MONOTONIC, &finish);
+            printf("\tPass %d written after %f seconds\n", step,
+                   (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1e9);
+        }
+    } else if(state_path) {
+        steals = sched_run(pool, state.bands, state_task, &job);
+    } else {
+        steals = sched_run(pool, job.tilesX * ((job.rows + TILE_WIDTH - 1) / TILE_WIDTH), tile_task, &job);
+
+        /** Bottom rows mirror the top ones, bar column 0 of an even width */
+        if(job.rows < szY) {
+            if(plane_mirror(0, szX) < 0)
+                kernel_tile(&plane, job.rows, 0, szY - job.rows, 1, (int*) frame_at(&image, job.rows, 0), image.pitch);
+
+            frame_mirror(&image, job.rows);
+        }
+    }
+
+    for(i = 0; i < nthreads; i++)
+        skipped += job.skipped[i];
+
     /** End the clock */
-    finish = clock() - start;
-    elapsed_time = ((float) finish) / ((float) CLOCKS_PER_SEC);
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+    elapsed_time = (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1e9;
 
     /** Print information regarding algorithm and run time */
     printf("Algorithm completed for,\n\t%d * %d pixels\n\t%d maximum iterations\n\t\tin %f seconds.\n", \
@@ -107,72 +498,275 @@ int main(int argc, char* argv[])
            max_iterations, \
            elapsed_time);
 
-    /** Plot the image */
-    plot(image, img, szX, szY);
+    if(nthreads > 1)
+        printf("\t%d threads, %ld steals\n", nthreads, steals);
+
+    if(progressive)
+        printf("\t%ld pixels filled by refinement\n", skipped);
+    else if(state_path)
+        printf("\t%ld of %ld pixels iterated\n", skipped, (long) szX * szY);
+    else if(subdivide)
+        printf("\t%ld pixels filled by subdivision\n", skipped);
+
+    if(job.rows < szY)
+        printf("\t%d of %d rows mirrored\n", szY - job.rows, szY);
+
+    if(plane.orbit) {
+        printf("\t%ld rebases onto the reference orbit\n", orbit.rebases);
+        zoom_release(&orbit);
+    }
+
+    if(job.cache) {
+        cache_stats(job.cache, &hits, &lookups);
+        printf("\t%ld of %ld tiles from the cache\n", hits, lookups);
+        cache_close(job.cache);
+    }
+
+    /** Kept for a later run with a higher cap */
+    if(state_path) {
+        if(state_save(&state, state_path, &plane) != 0)
+            printf("Could not write state file %s\n", state_path);
+
+        state_release(&state);
+    }
+
+    /** Progressive and carried on renders do not go through whole tiles, their
+    image is only counted up once it is complete */
+    if(bench_path && (progressive || state_path))
+        bench_add(&job.work[0], bench_now(), (int*) image.data, szY, szX, image.pitch);
+
+    /** Plot the image, already written when streaming, mapped or progressive */
+    if(mapped)
+        mapped_close(&map);
+    else if(progressive)
+        frame_destroy(&image);
+    else if(stream) {
+        for(i = 0; i < STREAM_BANDS; i++)
+            free(ring.bands[i]);
+
+        pthread_mutex_destroy(&ring.lock);
+        pthread_cond_destroy(&ring.cond);
+    } else {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        palette_frame(&image, img, pool);
+        clock_gettime(CLOCK_MONOTONIC, &finish);
+        plot_time = (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1e9;
+
+        printf("\tImage plotted in %f seconds.\n", plot_time);
+
+        frame_destroy(&image);
+    }
+
+    if(!mapped && !progressive)
+        fclose(img);
+
+    /** Threads of the one process are the workers, nothing is communicated */
+    if(bench_path) {
+        record.driver = "DYNAMIC";
+        record.width = szX;
+        record.height = szY;
+        record.frames = 1;
+        record.chunk = TILE_WIDTH;
+        record.max_iterations = max_iterations;
+        record.c = c;
+        record.ranks = 1;
+        record.threads = nthreads;
+        record.wall = elapsed_time + plot_time;
+        record.compute = elapsed_time;
+        record.io = plot_time;
+        record.comm = 0;
+        record.iterations = 0;
+        busy = (double *)malloc(nthreads * sizeof(double));
+
+        for(i = 0; i < nthreads; i++) {
+            record.iterations += job.work[i].iterations;
+            busy[i] = job.work[i].busy;
+        }
+
+        record.imbalance = bench_imbalance(busy, nthreads);
 
-    fclose(img);
+        if(bench_write(bench_path, &record) != 0)
+            printf("Could not write benchmark record to %s\n", bench_path);
 
-    for(i = 0; i < szX; i++)
-        free(image[i]);
+        free(busy);
+    }
+
+    sched_destroy(pool);
+    palette_release();
+
+    for(i = 0; i < nthreads; i++)
+        free(job.tile_bufs[i]);
 
-    free(image);
+    free(job.tile_bufs);
+    free(job.skipped);
+    free(job.work);
+    free(scratch);
 
     /** Successful return */
     return 0;
 }
 
 /**
-Iterating function
+Tile task
 */
-int iterator(Complex c, int max_iterations, double re, double im)
+void tile_task(void* arg, int task, int thread)
 {
-    /** Variable 'z' of type Complex structure */
-    Complex z;
-    int itCount;
+    TileJob* job = (TileJob*) arg;
+    int* tile_buf = job->tile_bufs[thread];
+    int stride = TILE_WIDTH;
+    int i = job->y0 + (task / job->tilesX) * TILE_WIDTH;
+    int j = (task % job->tilesX) * TILE_WIDTH;
+    int th = job->rows - i < TILE_WIDTH ? job->rows - i : TILE_WIDTH;
+    int tw = job->plane->width - j < TILE_WIDTH ? job->plane->width - j : TILE_WIDTH;
+    int k;
+    double since = bench_now();
+    CacheKey key;
+
+    /** Entirely in the mirrored rows */
+    if(th <= 0)
+        return;
+
+    /** The frame's own rows hold the tile unless it is being streamed */
+    if(job->image) {
+        tile_buf = (int*) frame_at(job->image, i, j);
+        stride = job->image->pitch;
+    }
 
-    /** Setting 'z' equal to the incoming grid co-ordinates */
-    z.re = re;
-    z.im = im;
+    cache_key(&key, job->plane, i, j, th, tw, job->subdivide);
 
-    /** Main loop of the algorithm which is ran 'max_iterations' number of times */
-    for(itCount = 0; itCount < max_iterations; itCount++) {
-        z = cmplx_add(cmplx_squared(z), c);
+    /** Solve by subdivision, filling uniform regions without iterating, or
+    iterate every pixel, unless an earlier render left the tile in the cache */
+    if(!cache_load(job->cache, &key, tile_buf, stride)) {
+        if(job->subdivide)
+            job->skipped[thread] += tile_solve(job->plane, i, j, th, tw, tile_buf, stride);
+        else
+            kernel_tile(job->plane, i, j, th, tw, tile_buf, stride);
 
-        if(cmplx_magnitude(z) > 4)
+        cache_store(job->cache, &key, tile_buf, stride);
+    }
+
+    bench_add(&job->work[thread], since, tile_buf, th, tw, stride);
+
+    if(job->band)
+        for(k = 0; k < th; k++)
+            palette_row(tile_buf + k * TILE_WIDTH, job->band + ((size_t)(i - job->y0 + k) * job->plane->width + j) * 3, tw);
+}
+
+/**
+Refinement band task
+*/
+void refine_task(void* arg, int task, int thread)
+{
+    TileJob* job = (TileJob*) arg;
+    int y = task * TILE_WIDTH;
+    int h = job->plane->height - y < TILE_WIDTH ? job->plane->height - y : TILE_WIDTH;
+    double since = bench_now();
+
+    job->skipped[thread] += refine_rows(job->plane, job->image, job->step, job->first, y, h);
+    bench_add(&job->work[thread], since, NULL, 0, 0, 0);
+}
+
+/**
+State band task
+*/
+void state_task(void* arg, int task, int thread)
+{
+    TileJob* job = (TileJob*) arg;
+    double since = bench_now();
+
+    job->skipped[thread] += state_band(job->state, job->plane, task);
+    bench_add(&job->work[thread], since, NULL, 0, 0, 0);
+}
+
+/**
+Pass writing function
+*/
+int refine_write(const Frame* image, int step, const char* path)
+{
+    char part[256];
+    FILE* img;
+
+    snprintf(part, sizeof(part), "%s.part", path);
+    img = fopen(part, "w");
+
+    if(img == NULL)
+        return -1;
+
+    fprintf(img, "P6\n%d %d 255\n", image->width, image->height);
+    refine_plot(image, step, img);
+
+    if(fclose(img) != 0)
+        return -1;
+
+    return rename(part, path);
+}
+
+/**
+Band writing thread
+*/
+void* band_writer(void* arg)
+{
+    BandRing* ring = (BandRing*) arg;
+    int slot;
+
+    pthread_mutex_lock(&ring->lock);
+
+    while(1) {
+        while(ring->written == ring->filled && !ring->done)
+            pthread_cond_wait(&ring->cond, &ring->lock);
+
+        if(ring->written == ring->filled)
             break;
+
+        slot = ring->written % STREAM_BANDS;
+
+        /** Write without holding the lock so the next band can be handed over */
+        pthread_mutex_unlock(&ring->lock);
+        fwrite(ring->bands[slot], 1, ring->sizes[slot], ring->img);
+        fflush(ring->img);
+        pthread_mutex_lock(&ring->lock);
+
+        ring->written++;
+        pthread_cond_broadcast(&ring->cond);
     }
 
-    /** Return the number of iterations */
-    return itCount;
+    pthread_mutex_unlock(&ring->lock);
+
+    return NULL;
 }
 
 /**
-Plotting function
+Band mirroring function
 */
-void plot(int** image, FILE* img, int szX, int szY)
+void band_mirror(TileJob* job, int from, int to, int fd, long header, unsigned char* scratch)
 {
-    /** Counters */
-    int i, j;
-    /** Array of byte values of the width of X dimension multiplied by three to accomodate
-    one byte each for R, G, and B */
-    unsigned char line[3 * szX];
-
-    for(i = 0; i < szY; i++) {
-        for(j = 0; j < szX; j++) {
-            if (image[j][i] <= 63) {
-                line[3 * j] = 255;
-                line[3 * j + 1] = line[ 3 * j + 2 ] = 255 - 4 * image[j][i];
+    int y, x, mx, my, count;
+    int width = job->plane->width;
+    ptrdiff_t row = (ptrdiff_t) 3 * width;
+    unsigned char *dst, *src;
+
+    for(y = from; y < to; y++) {
+        my = plane_mirror(y, job->plane->height);
+        dst = job->band + (y - job->y0) * row;
+
+        if(my >= job->y0 || fd < 0)
+            src = job->band + (my - job->y0) * row;
+        else {
+            if(pread(fd, scratch, row, header + (off_t) my * row) != row)
+                perror("Could not read back mirrored row");
+
+            src = scratch;
+        }
+
+        for(x = 0; x < width; x++) {
+            if((mx = plane_mirror(x, width)) >= 0) {
+                dst[3 * x] = src[3 * mx];
+                dst[3 * x + 1] = src[3 * mx + 1];
+                dst[3 * x + 2] = src[3 * mx + 2];
             } else {
-                line[3 * j] = 255;
-                line[3 * j + 1] = image[j][i] - 63;
-                line[3 * j + 2] = 0;
+                kernel_tile(job->plane, y, x, 1, 1, &count, 1);
+                palette_row(&count, dst + 3 * x, 1);
             }
-
-            if (image[j][i] == 320)
-                line[3 * j] = line[3 * j + 1] = line[3 * j + 2] = 255;
         }
-
-        /** Write 'line' array to 'img' handle */
-        fwrite(line, 1, 3 * szX, img);
     }
 }
@@ -1,75 +1,365 @@
 /***************************************************************************
  * Filename: fracFun_MS.c [testing]
- * Usage: mpirun [-np [0-9]] [-machinefile ./path/to/machine-file] ./bin/fracFun_MS
+ * Usage: mpirun [-np [0-9]] [-machinefile ./path/to/machine-file] ./bin/fracFun_MS [-C dir] [-c palette] [-f frames] [-J file] [-k depth] [-m] [-p] [-r] [-S policy] [-s] [-T file] [-t threads] [-v centre_re,centre_im,scale]
  * Author: Benjamin J Carrington
  ***************************************************************************/
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <unistd.h>
 #include <time.h>
+#include <pthread.h>
 #include "mpi.h"
 #include "cmplx.h"
+#include "kernel.h"
+#include "tile.h"
+#include "sched.h"
+#include "ppm.h"
+#include "pixel.h"
+#include "cache.h"
+#include "zoom.h"
+#include "bench.h"
+#include "trace.h"
 
+/**
+Image size, chunk size (the smallest tile handed out), and the frame rendered
+without a frames file; all can be set with -D at compile time
+*/
+#ifndef FULL_WIDTH
 #define FULL_WIDTH 1024
+#endif
+#ifndef CHUNK_WIDTH
 #define CHUNK_WIDTH 32
+#endif
+#ifndef MAX_ITER
 #define MAX_ITER 1000
+#endif
+#ifndef C_RE
+#define C_RE 0.285
+#endif
+#ifndef C_IM
+#define C_IM 0.01
+#endif
+#define PREFETCH_DEPTH 2
+
+/**
+Values a frame of a sweep is given by: c_re c_im max_iterations centre_re
+centre_im scale, as on a line of the frames file, all but c optional; then
+the parts of centre_re and centre_im below double precision, as the centre
+is read to double-double for deep zooms
+*/
+#define SWEEP_PARAMS 8
+
+/**
+sweep_claim() results when no tile is handed out
+*/
+#define SWEEP_DONE -1
+#define SWEEP_WAIT -2
+
+/**
+How many chunks a tile is made of. A fixed tile is one chunk. A guided tile
+takes 1 / workers of the chunks left; factoring hands chunks out in batches
+of one tile per worker, each batch taking half of the chunks left. Either way
+tiles start large and shrink to single chunks by the end, which keeps the
+last workers to finish close together with a fraction of the messages.
+Tiles are at most SWEEP_MAX_ROWS rows of chunks
+*/
+typedef enum SweepPolicy
+{
+    SWEEP_FIXED = 0,
+    SWEEP_GUIDED,
+    SWEEP_FACTORING
+} SweepPolicy;
+
+#define SWEEP_MAX_ROWS 8
+
+/**
+A rectangle of whole chunks of frame 'frame', 'h' * 'w' pixels from ('y',
+'x'): a run of chunks along one row of chunks, or whole rows of them. 'first'
+is its top left chunk, counted across frames. Sent to clients as TILE_INTS
+ints, and results come back tagged TILE_TAG, in the order the tiles went out
+*/
+typedef struct Tile
+{
+    int frame, first;
+    int y, x, h, w;
+} Tile;
 
-void plot(int* image_arr, FILE* img);
-long iterator(Complex c, double im, double re);
+#define TILE_INTS 6
+#define TILE_TAG 1
+
+/**
+Frames rendered in one run: the default frame, or every frame of a frames
+file. Chunks are counted across frames, chunk 'g' being chunk
+g % 'num_chunks' of frame g / 'num_chunks', so clients go straight on from
+one frame to the next. Tiles are claimed from 'next_chunk' on as 'policy'
+sizes them for 'workers' workers, factoring's batch having 'batch_left'
+tiles of 'batch' chunks to go; 'tiles' counts them and no tile is more than
+'max_pixels' pixels. The master holds two frames' images, frame f in
+'images'[f % 2], with 'done' counting the chunks of each that are in; a
+complete frame is written out by the writer thread (mirroring the rows from
+'rows' on first) while the next one is computed, and chunks of frame f are
+only handed out once f < 'written' + 2. Frames are written to 'pattern'
+formatted with the frame number. On the master, tiles found in 'cache' (if
+not NULL, keyed chunk by chunk with 'subdivide') are filled in from it rather
+than computed. 'io' is the time the writer spends colouring and writing
+frames, each of which it records in 'trace'
+*/
+typedef struct Sweep
+{
+    int nframes;
+    Plane* planes;
+    int num_chunks, rows;
+    int next_chunk;
+    SweepPolicy policy;
+    int workers, batch, batch_left;
+    int tiles, max_pixels;
+    Frame images[2];
+    int done[2];
+    int written;
+    const char* pattern;
+    int nthreads;
+    TileCache* cache;
+    int subdivide;
+    double io;
+    TraceLog* trace;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} Sweep;
+
+/**
+Chunks a rank has computed and colourized itself when writing with MPI-IO:
+'n' chunk numbers (within the frame) and their pixels, three bytes each, one
+chunk after another
+*/
+typedef struct ChunkStore
+{
+    int n, cap;
+    int* chunks;
+    unsigned char* rgb;
+    pthread_mutex_t lock;
+} ChunkStore;
+
+/**
+Work shared by the threads of a rank. Clients split each tile they are
+sent into 'bands' bands of rows, one pool task each; the master's compute
+threads instead claim whole tiles from 'sweep', which the master also hands
+tiles out to clients from, and pack them into its images. Each thread adds
+the time it spends computing to its own 'work', and the master's compute
+threads record each tile in their own 'trace'
+*/
+typedef struct ChunkJob
+{
+    const Plane* plane;
+    int subdivide;
+    Tile tile;
+    int* out;
+    int stride;
+    int bands;
+    Sweep* sweep;
+    long* skipped;
+    BenchWork* work;
+    TraceLog* trace;
+    ChunkStore* store;
+} ChunkJob;
+
+/**
+Master's view of the clients: each has up to 'depth' tiles in flight, with
+a receive of 'pixel's posted straight into the sweep's image for every one
+of them (slots 'depth' * client onwards in 'recv_reqs' and 'tiles', free
+slots are MPI_REQUEST_NULL). 'assigned' holds the last batch of tiles sent to
+each client; 'alive' counts the clients not yet told to exit. 'counts' holds
+tiles going in and out of the tile cache. Assignments are recorded in 'trace'
+*/
+typedef struct Dispatch
+{
+    int depth;
+    Sweep* sweep;
+    MPI_Datatype pixel;
+    int* assigned;
+    Tile* tiles;
+    MPI_Request* assign_reqs;
+    MPI_Request* recv_reqs;
+    int* outstanding;
+    int* terminated;
+    int alive;
+    int* counts;
+    TraceLog* trace;
+} Dispatch;
+
+/**
+Master compute thread, with its own index into 'skipped'
+*/
+typedef struct MasterThread
+{
+    ChunkJob* job;
+    int thread;
+} MasterThread;
+
+/**
+Top left pixel ('y', 'x') of chunk number 'chunk'
+*/
+static inline void chunk_origin(int chunk, int* y, int* x)
+{
+    *y = (chunk / (FULL_WIDTH / CHUNK_WIDTH)) * CHUNK_WIDTH;
+    *x = (chunk % (FULL_WIDTH / CHUNK_WIDTH)) * CHUNK_WIDTH;
+}
+
+/**
+Iterations computed so far by the 'n' threads of 'work'
+*/
+static inline long long work_iterations(const BenchWork* work, int n)
+{
+    long long total = 0;
+    int i;
+
+    for(i = 0; i < n; i++)
+        total += work[i].iterations;
+
+    return total;
+}
+
+/**
+Reads the frames file 'path', one frame per line (see SWEEP_PARAMS; blank
+lines and lines starting with '#' are skipped), into '*params', which the
+caller frees; what a line leaves out is taken from 'defaults'. Returns the
+number of frames, or -1 if the file cannot be read or a line is malformed
+*/
+int sweep_read(const char* path, const double* defaults, double** params);
+
+/**
+Claims the next tile to compute into 'tile', sized by the sweep's policy and
+never crossing into the next frame; returns 0. If its frame's image is still
+held by a frame being written out, waits for it if 'wait', otherwise returns
+SWEEP_WAIT; returns SWEEP_DONE once every chunk is claimed
+*/
+int sweep_claim(Sweep* sweep, int wait, Tile* tile);
+
+/**
+Waits until the next chunk can be claimed or every chunk is claimed
+*/
+void sweep_wait(Sweep* sweep);
+
+/**
+Counts the chunks of 'tile' in, waking the writer when they complete its frame
+*/
+void sweep_done(Sweep* sweep, const Tile* tile);
+
+/**
+Writer thread: mirrors, colours and writes each frame once it is complete
+*/
+void* sweep_writer(void* arg);
+
+/**
+Computes the 'h' * 'w' block at ('y', 'x') into 'out' as iterations + 1,
+accounting it to 'work' (if not NULL); returns the number of pixels filled
+by subdivision
+*/
+long chunk_compute(const Plane* plane, int subdivide, int y, int x, int h, int w, int* out, int stride, BenchWork* work);
+
+/**
+Looks the chunks of 'tile' up in the sweep's tile cache, stopping at the
+first one missing; if they are all there packs the tile into its frame's
+image and counts it done, going through 'buf'. Returns 1 if they were
+*/
+int tile_lookup(Sweep* sweep, const Tile* tile, int* buf);
+
+/**
+Adds the chunks of 'tile' to the sweep's tile cache from 'counts'
+(iterations + 1, 'w' ints between rows), which it overwrites
+*/
+void tile_keep(Sweep* sweep, const Tile* tile, int* counts);
+
+/**
+Colourizes each chunk of 'tile' from 'counts' ('w' ints between rows) into
+'store'
+*/
+void store_tile(ChunkStore* store, const Tile* tile, const int* counts);
+
+/**
+Pool task: band 'task' of the tile in 'arg'
+*/
+void chunk_task(void* arg, int task, int thread);
+
+/**
+Master compute thread: takes tiles from the shared counter until none are left
+*/
+void* master_compute(void* arg);
+
+/**
+Claims up to 'n' tiles for client 'dest' and sends them as one message,
+posting a receive for each result; tells the client to exit once there are
+none left. Tiles found in the tile cache are filled in straight away
+instead. Returns the number of tiles assigned
+*/
+int assign_tiles(Dispatch* dispatch, int dest, int n);
 
 int main(int argc, char* argv[])
 {
-    int *image_arr;
+    pixel_t *image_arr;
+    int *counts_arr;
+    double *params, defaults[SWEEP_PARAMS];
     int pixel_YX[3];
-    int Y_start, X_start, CUR_CHUNK, disp = 0;
-    int i, j;
-    Complex c;
-    FILE *img;
-    int NUM_CHUNKS = (FULL_WIDTH / CHUNK_WIDTH) * (FULL_WIDTH / CHUNK_WIDTH);
+    int disp = 0;
+    int i, j, opt, subdivide = 0, nthreads = 1, provided;
+    int outstanding = 0, nhelpers, depth = PREFETCH_DEPTH, periodic = 0, nframes = 1, max_count;
+    int *batch, head, queued, done, slot, count, flag, mpiio = 0;
+    Tile *queue, tile;
+    SweepPolicy policy = SWEEP_FACTORING;
+    const char* policies[] = {"fixed", "guided", "factoring"};
+    int symmetric = 0, rows = FULL_WIDTH;
+    long skipped = 0, total_skipped, hits, lookups, rebases = 0, total_rebases;
+    char *optEnd_p;
+    const char* palette = "classic";
+    const char* frames = NULL;
+    const char* cache_dir = NULL;
+    const char* viewport = NULL;
+    const char* bench_path = NULL;
+    const char* trace_path = NULL;
+    const char** trace_names;
+    TraceLog* trace;
+    double min_scale, since;
+    long long before;
+    ChunkJob job;
+    SchedPool* pool;
+    pthread_t* helpers;
+    MasterThread* helper_args;
+    Dispatch dispatch;
+    Sweep sweep;
+    Plane view;
+    Orbit* orbits;
+    int deep = 0;
+    ChunkStore store;
+    PpmFile ppm;
+    pthread_t writer;
 
     /** Timing variables */
     double start, stop;
-    float elapsed_time;
+    float elapsed_time, write_time = 0;
+    BenchRecord record;
+    int workers;
 
     /** MPI specific variables */
     MPI_Status status, stat_recv;
-    MPI_Request request;
-    MPI_Datatype CHUNKxCHUNK, CHUNKxCHUNK_RE;
+    MPI_Request request, assign_req;
+    MPI_Request* send_reqs;
+    MPI_Datatype PIXEL, memtype, filetype;
     int rankID, numProcs, numSlaves;
 
-    /** Initialisation of MPI environment */
-    MPI_Init(&argc, &argv);
+    /** Initialisation of MPI environment; only the main thread makes MPI calls */
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
     MPI_Barrier(MPI_COMM_WORLD);
     MPI_Comm_size(MPI_COMM_WORLD, &numProcs);
     MPI_Comm_rank(MPI_COMM_WORLD, &rankID);
     MPI_Barrier(MPI_COMM_WORLD);
 
-    /** Variables for type creation */
-    int full_sizes[2] = {FULL_WIDTH, FULL_WIDTH};
-    int sub_sizes[2] = {CHUNK_WIDTH, CHUNK_WIDTH};
-    int starting[2] = {0, 0};
     int sendcounts[numProcs];
     int displs[numProcs];
 
-    /** Create CHUNK by CHUNK type */
-    MPI_Type_create_subarray(
-        2,
-        full_sizes,
-        sub_sizes,
-        starting,
-        MPI_ORDER_C,
-        MPI_INT,
-        &CHUNKxCHUNK
-    );
-    /** Specify offset */
-    MPI_Type_create_resized(
-        CHUNKxCHUNK,
-        0,
-        CHUNK_WIDTH * sizeof(int),
-        &CHUNKxCHUNK_RE
-    );
-    /** Commit type to be used */
-    MPI_Type_commit(&CHUNKxCHUNK_RE);
+    /** Pixel type of whichever pixel format is built in; each tile received
+    gets a type placing it in the image */
+    pixel_type_create(&PIXEL);
 
     /** # clients */
     numSlaves = numProcs - 1;
@@ -80,190 +370,689 @@ int main(int argc, char* argv[])
 
     MPI_Barrier(MPI_COMM_WORLD);
 
-    /** Hardcode constant */
-    c.re = 0.285;
-    c.im = 0.01;
+    /** Options section */
+    while((opt = getopt(argc, argv, "C:c:f:J:k:mprS:sT:t:v:")) != -1) {
+        switch(opt) {
+        case 'C':
+            cache_dir = optarg;
+            break;
+        case 'c':
+            palette = optarg;
+            break;
+        case 'f':
+            frames = optarg;
+            break;
+        case 'J':
+            bench_path = optarg;
+            break;
+        case 'k':
+            depth = strtol(optarg, &optEnd_p, 10);
 
-    /** Master process portion of program */
+            if(*optEnd_p || depth < 1) {
+                if(rankID == 0)
+                    printf("Prefetch depth must be a positive integer\n");
+
+                MPI_Finalize();
+                return 1;
+            }
+
+            break;
+        case 'm':
+            mpiio = 1;
+            break;
+        case 'p':
+            periodic = 1;
+            break;
+        case 'r':
+            symmetric = 1;
+            break;
+        case 'S':
+            for(policy = SWEEP_FIXED; policy <= SWEEP_FACTORING; policy++)
+                if(strcmp(optarg, policies[policy]) == 0)
+                    break;
+
+            if(policy > SWEEP_FACTORING) {
+                if(rankID == 0)
+                    printf("Scheduling policy must be fixed, guided or factoring\n");
+
+                MPI_Finalize();
+                return 1;
+            }
+
+            break;
+        case 's':
+            subdivide = 1;
+            break;
+        case 'T':
+            trace_path = optarg;
+            break;
+        case 't':
+            nthreads = strtol(optarg, &optEnd_p, 10);
+
+            if(*optEnd_p || nthreads < 1) {
+                if(rankID == 0)
+                    printf("Thread count must be a positive integer\n");
+
+                MPI_Finalize();
+                return 1;
+            }
+
+            break;
+        case 'v':
+            viewport = optarg;
+            break;
+        default:
+            MPI_Finalize();
+            return 1;
+        }
+    }
+
+    /** Viewport of the hardcoded frame, and of frames that give none */
+    view.centre.re = view.centre.im = 0;
+    view.centre_lo.re = view.centre_lo.im = 0;
+    view.scale = 1;
+
+    if(viewport && zoom_viewport(viewport, &view) != 0) {
+        if(rankID == 0)
+            printf("Viewport must be centre_re,centre_im,scale with a positive scale\n");
+
+        MPI_Finalize();
+        return 1;
+    }
+
+    defaults[0] = C_RE;
+    defaults[1] = C_IM;
+    defaults[2] = MAX_ITER;
+    defaults[3] = view.centre.re;
+    defaults[4] = view.centre.im;
+    defaults[5] = view.scale;
+    defaults[6] = view.centre_lo.re;
+    defaults[7] = view.centre_lo.im;
+
+    if(frames && mpiio) {
+        if(rankID == 0)
+            printf("A frames file cannot be combined with MPI-IO\n");
+
+        MPI_Finalize();
+        return 1;
+    }
+
+    if(cache_dir && mpiio) {
+        if(rankID == 0)
+            printf("The tile cache fills in chunks on the master, it cannot be combined with MPI-IO\n");
+
+        MPI_Finalize();
+        return 1;
+    }
+
+    /** The master reads the frames and hands them to everybody; without a
+    file there is the one hardcoded frame */
     if(rankID == 0) {
-        img = fopen("image_out.ppm", "w");
+        if(frames)
+            nframes = sweep_read(frames, defaults, &params);
+        else {
+            params = (double *)malloc(SWEEP_PARAMS * sizeof(double));
+            memcpy(params, defaults, SWEEP_PARAMS * sizeof(double));
+        }
+
+        if(nframes < 0)
+            printf("Could not read frames from %s\n", frames);
+        else if(nframes == 0)
+            printf("No frames in %s\n", frames);
+    }
+
+    MPI_Bcast(&nframes, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    if(nframes <= 0) {
+        MPI_Finalize();
+        return 1;
+    }
+
+    if(rankID != 0)
+        params = (double *)malloc((size_t) nframes * SWEEP_PARAMS * sizeof(double));
+
+    MPI_Bcast(params, nframes * SWEEP_PARAMS, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    /** Pixels mapped between centre - scale and centre + scale */
+    sweep.nframes = nframes;
+    sweep.planes = (Plane *)malloc(nframes * sizeof(Plane));
+    orbits = (Orbit *)malloc(nframes * sizeof(Orbit));
+    max_count = 0;
+    min_scale = params[5];
+
+    for(i = 0; i < nframes; i++) {
+        sweep.planes[i].c.re = params[i * SWEEP_PARAMS];
+        sweep.planes[i].c.im = params[i * SWEEP_PARAMS + 1];
+        sweep.planes[i].max_iterations = (int) params[i * SWEEP_PARAMS + 2];
+        sweep.planes[i].exponent = 2;
+        sweep.planes[i].width = sweep.planes[i].height = FULL_WIDTH;
+        sweep.planes[i].transpose = 0;
+        sweep.planes[i].centre.re = params[i * SWEEP_PARAMS + 3];
+        sweep.planes[i].centre.im = params[i * SWEEP_PARAMS + 4];
+        sweep.planes[i].scale = params[i * SWEEP_PARAMS + 5];
+        sweep.planes[i].centre_lo.re = params[i * SWEEP_PARAMS + 6];
+        sweep.planes[i].centre_lo.im = params[i * SWEEP_PARAMS + 7];
+        sweep.planes[i].orbit = NULL;
+
+        if(sweep.planes[i].max_iterations + 1 > max_count)
+            max_count = sweep.planes[i].max_iterations + 1;
+
+        if(sweep.planes[i].scale < min_scale)
+            min_scale = sweep.planes[i].scale;
+
+        /** Only mirrored if every frame is symmetric */
+        if(!plane_symmetric(&sweep.planes[i]))
+            symmetric = 0;
+    }
+
+    free(params);
+
+    if(max_count > PIXEL_COUNT_MAX) {
+        if(rankID == 0)
+            printf("Counts up to %d do not fit the pixel format\n", max_count);
+
+        MPI_Finalize();
+        return 1;
+    }
+
+    /** Frames too deep for double are iterated as offsets from a reference
+    orbit, which every rank computes for itself */
+    for(i = 0; i < nframes; i++) {
+        if(!zoom_deep(&sweep.planes[i]))
+            continue;
+
+        if(zoom_orbit(&orbits[i], &sweep.planes[i]) != 0) {
+            printf("Proc: %d \tCould not allocate reference orbit\n", rankID);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        sweep.planes[i].orbit = &orbits[i];
+        deep++;
+    }
+
+    if(rankID == 0 && deep > 0)
+        printf("\tDeep zoom:\t%d of %d frames\n", deep, nframes);
+
+    /** Periodicity checking, tolerance tied to the finest pixel spacing */
+    if(periodic)
+        kernel_periodicity(KERNEL_PERIOD_TOL(2.0 * min_scale / FULL_WIDTH));
+
+    /** Every rank that colours pixels needs the palette; a gradient spans the
+    counts of the frame with the highest cap */
+    if(palette_select(palette, max_count) != 0) {
+        if(rankID == 0)
+            printf("Unknown palette %s\n", palette);
+
+        MPI_Finalize();
+        return 1;
+    }
+
+    /** Symmetric images only compute the rows of chunks down to just past the
+    centre, the master mirrors the rest into its image */
+    if(symmetric) {
+        if(mpiio) {
+            if(rankID == 0)
+                printf("Mirroring needs the whole image on the master, it cannot be combined with MPI-IO\n");
+
+            MPI_Finalize();
+            return 1;
+        }
 
-        if(img == NULL) {
-            printf("Could not open handle to image\n");
+        rows = (plane_half(FULL_WIDTH) + CHUNK_WIDTH - 1) / CHUNK_WIDTH * CHUNK_WIDTH;
+    }
+
+    sweep.num_chunks = (rows / CHUNK_WIDTH) * (FULL_WIDTH / CHUNK_WIDTH);
+    sweep.rows = rows;
+    sweep.next_chunk = 0;
+    sweep.policy = policy;
+    sweep.batch_left = 0;
+    sweep.tiles = 0;
+    sweep.max_pixels = policy == SWEEP_FIXED ? CHUNK_WIDTH * CHUNK_WIDTH :
+                       (rows < SWEEP_MAX_ROWS * CHUNK_WIDTH ? rows : SWEEP_MAX_ROWS * CHUNK_WIDTH) * FULL_WIDTH;
+    sweep.done[0] = sweep.done[1] = 0;
+    sweep.written = 0;
+    sweep.images[0].data = sweep.images[1].data = NULL;
+    sweep.pattern = frames ? "image_%05d.ppm" : "image_out.ppm";
+    sweep.subdivide = subdivide;
+    sweep.cache = NULL;
+    sweep.io = 0;
+    pthread_mutex_init(&sweep.lock, NULL);
+    pthread_cond_init(&sweep.cond, NULL);
+
+    if(nthreads > 1 && provided < MPI_THREAD_FUNNELED) {
+        if(rankID == 0)
+            printf("MPI library has no thread support, running single threaded\n");
+
+        nthreads = 1;
+    }
+
+    if(rankID == 0)
+        printf("\tNum Threads:\t%d\n\tPrefetch:\t%d\n\tScheduling:\t%s\n", nthreads, depth, policies[policy]);
+
+    sweep.nthreads = nthreads;
+    job.subdivide = subdivide;
+    job.sweep = &sweep;
+    job.skipped = (long *)calloc(nthreads, sizeof(long));
+    job.work = (BenchWork *)calloc(nthreads, sizeof(BenchWork));
+    job.store = NULL;
+
+    /** One log for the main thread, one for each of the master's compute
+    threads and one for its writer */
+    trace = trace_create(MPI_COMM_WORLD, nthreads + 2, trace_path != NULL);
+    trace_names = (const char **)malloc((nthreads + 2) * sizeof(const char *));
+    trace_names[0] = "main";
+    trace_names[nthreads + 1] = "writer";
+
+    for(i = 1; i <= nthreads; i++)
+        trace_names[i] = "compute";
+
+    job.trace = trace + 1;
+    sweep.trace = trace + nthreads + 1;
+
+    /** With MPI-IO every rank colourizes and writes its own chunks, so the
+    master never holds the whole image */
+    if(mpiio) {
+        if(ppm_open(&ppm, MPI_COMM_WORLD, "image_out.ppm", FULL_WIDTH, FULL_WIDTH) != MPI_SUCCESS) {
+            if(rankID == 0)
+                printf("Could not open handle to image\n");
+
+            MPI_Finalize();
             return 1;
         }
 
-        fprintf(img, "P6\n%d %d 255\n", FULL_WIDTH, FULL_WIDTH);
+        store.n = 0;
+        store.cap = 16;
+        store.chunks = (int *)malloc(store.cap * sizeof(int));
+        store.rgb = (unsigned char *)malloc(store.cap * 3 * CHUNK_WIDTH * CHUNK_WIDTH);
+        pthread_mutex_init(&store.lock, NULL);
+        job.store = &store;
+    }
 
-        image_arr = (int  *)malloc(FULL_WIDTH * FULL_WIDTH * sizeof(int));
+    /** Master process portion of program */
+    if(rankID == 0) {
+        image_arr = NULL;
+
+        /** Only the master reads and adds to the tile cache */
+        if(cache_dir && (sweep.cache = cache_open(cache_dir, CACHE_MAX_BYTES)) == NULL)
+            printf("Could not open tile cache %s, computing every chunk\n", cache_dir);
+
+        /** One image per frame in flight, written out by 'writer' */
+        if(!mpiio) {
+            for(i = 0; i < (nframes > 1 ? 2 : 1); i++)
+                if(frame_create(&sweep.images[i], FULL_WIDTH, FULL_WIDTH, sizeof(pixel_t)) != 0) {
+                    printf("Could not allocate image\n");
+                    return 1;
+                }
+
+            pthread_create(&writer, NULL, sweep_writer, &sweep);
+        }
 
         /** Start timer */
         start = MPI_Wtime();
 
-        /** Calculate X and Y pixels and send to each client */
-        for(pixel_YX[2] = 0; pixel_YX[2] < numSlaves; pixel_YX[2]++) {
-            pixel_YX[0] = (pixel_YX[2] / (FULL_WIDTH / CHUNK_WIDTH)) * CHUNK_WIDTH; // Y
-            pixel_YX[1] = (pixel_YX[2] % (FULL_WIDTH / CHUNK_WIDTH)) * CHUNK_WIDTH; // X
+        /** Master's own compute threads write straight into the image; the
+        main thread only computes as well if there are no clients to serve */
+        nhelpers = numSlaves > 0 ? nthreads - 1 : nthreads;
+        sweep.workers = numSlaves + nhelpers;
+        helpers = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+        helper_args = (MasterThread *)malloc(nthreads * sizeof(MasterThread));
 
-            MPI_Send(
-                pixel_YX,
-                3,
-                MPI_INT,
-                pixel_YX[2] + 1,
-                0,
-                MPI_COMM_WORLD
-            );
+        for(i = 0; i < nthreads; i++) {
+            helper_args[i].job = &job;
+            helper_args[i].thread = i;
         }
 
-        /** Update current chunk and pixel for next send */
-        pixel_YX[2] = numSlaves;
-        pixel_YX[0] = (pixel_YX[2] / (FULL_WIDTH / CHUNK_WIDTH)) * CHUNK_WIDTH; // Y
-        pixel_YX[1] = (pixel_YX[2] % (FULL_WIDTH / CHUNK_WIDTH)) * CHUNK_WIDTH; // X
-
-        /** Recieve current chunk from X and send next chunk to X */
-        while(pixel_YX[2] < NUM_CHUNKS) {
-            /** Probe recieve buffer, calculate displacement within array, and receive */
-            MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &stat_recv);
-
-            disp = ((stat_recv.MPI_TAG * CHUNK_WIDTH) % FULL_WIDTH) +
-                   (((stat_recv.MPI_TAG * CHUNK_WIDTH) / FULL_WIDTH) * CHUNK_WIDTH * FULL_WIDTH);
-
-            MPI_Recv(
-                image_arr + disp,
-                1,
-                CHUNKxCHUNK_RE,
-                stat_recv.MPI_SOURCE,
-                stat_recv.MPI_TAG,
-                MPI_COMM_WORLD,
-                &status
-            );
+        for(i = 1; i < nhelpers; i++)
+            pthread_create(&helpers[i], NULL, master_compute, &helper_args[i]);
 
-#ifdef DEBUG
-            printf("Proc: MA\tJob: Recieved [# %d]\n", stat_recv.MPI_TAG);
-#endif
+        if(numSlaves > 0 && nhelpers > 0)
+            pthread_create(&helpers[0], NULL, master_compute, &helper_args[0]);
 
-            MPI_Send(
-                pixel_YX,
-                3,
-                MPI_INT,
-                status.MPI_SOURCE,
-                0,
-                MPI_COMM_WORLD
-            );
+        /** Clients are kept 'depth' tiles ahead, so they never wait on a round
+        trip to the master between tiles */
+        dispatch.depth = depth;
+        dispatch.sweep = &sweep;
+        dispatch.pixel = PIXEL;
+        dispatch.assigned = (int *)malloc(numSlaves * depth * TILE_INTS * sizeof(int));
+        dispatch.tiles = (Tile *)malloc(numSlaves * depth * sizeof(Tile));
+        dispatch.assign_reqs = (MPI_Request *)malloc(numSlaves * sizeof(MPI_Request));
+        dispatch.recv_reqs = (MPI_Request *)malloc(numSlaves * depth * sizeof(MPI_Request));
+        dispatch.outstanding = (int *)calloc(numSlaves, sizeof(int));
+        dispatch.terminated = (int *)calloc(numSlaves, sizeof(int));
+        dispatch.alive = numSlaves;
+        dispatch.counts = (int *)malloc(sweep.max_pixels * sizeof(int));
+        dispatch.trace = trace;
 
-            /** pixel_YX to next chunk values */
-            pixel_YX[2]++;
-            pixel_YX[0] = (pixel_YX[2] / (FULL_WIDTH / CHUNK_WIDTH)) * CHUNK_WIDTH;
-            pixel_YX[1] = (pixel_YX[2] % (FULL_WIDTH / CHUNK_WIDTH)) * CHUNK_WIDTH;
-        }
+        for(i = 0; i < numSlaves; i++)
+            dispatch.assign_reqs[i] = MPI_REQUEST_NULL;
 
-        /** Final recieves to match initial sends */
-        for(i = 0; i < numSlaves; i++) {
-            MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &stat_recv);
+        for(i = 0; i < numSlaves * depth; i++)
+            dispatch.recv_reqs[i] = MPI_REQUEST_NULL;
 
-            disp = ((stat_recv.MPI_TAG * CHUNK_WIDTH) % FULL_WIDTH) + (((stat_recv.MPI_TAG * CHUNK_WIDTH) / FULL_WIDTH) * CHUNK_WIDTH * FULL_WIDTH);
+        /** Fill each client's queue */
+        for(i = 1; i <= numSlaves; i++)
+            outstanding += assign_tiles(&dispatch, i, depth);
+
+        /** Wait for any tile to land, topping its client back up once half
+        of its queue has drained so assignments go out in batches */
+        while(dispatch.alive > 0 || outstanding > 0) {
+            /** Nothing in flight: the next frame is waiting for an image to
+            be written out, top everybody up once it can go */
+            if(outstanding == 0) {
+                since = MPI_Wtime();
+                sweep_wait(&sweep);
+                trace_event(trace, TRACE_WAIT, since, -1, 0, 0);
+
+                for(i = 0; i < numSlaves; i++)
+                    if(!dispatch.terminated[i])
+                        outstanding += assign_tiles(&dispatch, i + 1, depth - dispatch.outstanding[i]);
+
+                continue;
+            }
+
+            since = MPI_Wtime();
+            MPI_Waitany(numSlaves * depth, dispatch.recv_reqs, &slot, &status);
+            tile = dispatch.tiles[slot];
+            trace_event(trace, TRACE_WAIT, since, tile.first, 0, 0);
 
-            MPI_Recv(
-                image_arr + disp,
-                1,
-                CHUNKxCHUNK_RE,
-                stat_recv.MPI_SOURCE,
-                stat_recv.MPI_TAG,
-                MPI_COMM_WORLD,
-                &status
-            );
 #ifdef DEBUG
-            printf("Proc: MA\tJob: Recieved [# %d]\n", stat_recv.MPI_TAG);
+            printf("Proc: MA\tJob: Recieved [# %d]\n", tile.first);
 #endif
+
+            /** Kept for later renders while it is still in the image */
+            if(sweep.cache &&
+               pixel_unpack((pixel_t*) frame_at(&sweep.images[tile.frame % 2], tile.y, tile.x),
+                            sweep.images[0].pitch, tile.h, tile.w, dispatch.counts, tile.w) == 0)
+                tile_keep(&sweep, &tile, dispatch.counts);
+
+            sweep_done(&sweep, &tile);
+
+            i = slot / depth;
+            dispatch.outstanding[i]--;
+            outstanding--;
+
+            if(!dispatch.terminated[i] && dispatch.outstanding[i] <= depth / 2)
+                outstanding += assign_tiles(&dispatch, i + 1, depth - dispatch.outstanding[i]);
         }
 
-        /** Terminate clients */
-        for(i = 0; i < numSlaves; i++)
-            MPI_Send(
-                0,
-                0,
-                MPI_INT,
-                i + 1,
-                0xFFFF,
-                MPI_COMM_WORLD
-            );
+        MPI_Waitall(numSlaves, dispatch.assign_reqs, MPI_STATUSES_IGNORE);
+
+        free(dispatch.assigned);
+        free(dispatch.tiles);
+        free(dispatch.assign_reqs);
+        free(dispatch.recv_reqs);
+        free(dispatch.outstanding);
+        free(dispatch.terminated);
+        free(dispatch.counts);
+
+        /** No clients, the main thread computes too */
+        if(numSlaves == 0)
+            master_compute(&helper_args[0]);
+
+        for(i = numSlaves > 0 ? 0 : 1; i < nhelpers; i++)
+            pthread_join(helpers[i], NULL);
+
+        free(helpers);
+        free(helper_args);
 
         /** Stop timer and calculate elapsed_time */
         stop = MPI_Wtime();
         elapsed_time = stop - start;
 
-#ifdef DEBUG
-        printf("Proc: Ma\tJob: Plotting image\n");
-#endif
-        plot(image_arr, img);
+        if(nframes == 1)
+            printf("Algorithm completed for,\n\t%d * %d pixels\n\t%d maximum iterations\n\t\tin %f seconds.\n", \
+                   FULL_WIDTH, FULL_WIDTH, \
+                   sweep.planes[0].max_iterations, \
+                   elapsed_time);
+        else
+            printf("Algorithm completed for,\n\t%d frames of %d * %d pixels\n\t\tin %f seconds.\n", \
+                   nframes, \
+                   FULL_WIDTH, FULL_WIDTH, \
+                   elapsed_time);
+
+        if(rows < FULL_WIDTH)
+            printf("\t%d of %d rows mirrored\n", FULL_WIDTH - rows, FULL_WIDTH);
 
-        printf("Algorithm completed for,\n\t%d * %d pixels\n\t%d maximum iterations\n\t\tin %f seconds.\n", \
-               FULL_WIDTH, FULL_WIDTH, \
-               MAX_ITER, \
-               elapsed_time);
+        if(sweep.cache) {
+            cache_stats(sweep.cache, &hits, &lookups);
+            printf("\t%ld of %ld chunks from the cache\n", hits, lookups);
+        }
 
-        fclose(img);
+        printf("\t%d tiles handed out\n", sweep.tiles);
+
+        /** Last frames still being written out */
+        if(!mpiio) {
+            pthread_join(writer, NULL);
+            record.wall = MPI_Wtime() - start;
+
+            if(nframes > 1)
+                printf("\tFrames written after %f seconds.\n", MPI_Wtime() - start);
+
+            frame_destroy(&sweep.images[0]);
+
+            if(nframes > 1)
+                frame_destroy(&sweep.images[1]);
+        }
+
+        if(sweep.cache)
+            cache_close(sweep.cache);
+
+        /** The main thread only hands chunks out while there are clients */
+        workers = numSlaves > 0 ? nhelpers : nthreads;
     }
     /** Client processes portion of program */
     else {
-        /** Everybody allocate their portion of image_arr */
-        image_arr = (int *)malloc(CHUNK_WIDTH * CHUNK_WIDTH * sizeof(int));
+        /** Everybody allocate their portion of image_arr, room for the
+        largest tile for each result that may still be on its way to the master */
+        image_arr = (pixel_t *)malloc((size_t) depth * sweep.max_pixels * sizeof(pixel_t));
+        counts_arr = (int *)malloc(sweep.max_pixels * sizeof(int));
+        send_reqs = (MPI_Request *)malloc(depth * sizeof(MPI_Request));
+        queue = (Tile *)malloc(depth * sizeof(Tile));
+        batch = (int *)malloc(depth * TILE_INTS * sizeof(int));
 
-        /** Loop indefinitely until `break;` */
+        for(i = 0; i < depth; i++)
+            send_reqs[i] = MPI_REQUEST_NULL;
+
+        /** Time waiting for the first assignment counts as communication */
+        start = MPI_Wtime();
+
+        /** Each tile is split into bands of rows across the rank's threads */
+        pool = sched_create(nthreads);
+        job.out = counts_arr;
+
+        head = queued = done = slot = 0;
+
+        MPI_Irecv(batch, depth * TILE_INTS, MPI_INT, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &assign_req);
+
+        /** Loop until the queue is empty and the master has said to exit */
         while(1) {
-            MPI_Recv(
-                pixel_YX,
-                3,
-                MPI_INT,
-                0,
-                MPI_ANY_TAG,
-                MPI_COMM_WORLD,
-                &status
-            );
+            /** Take in any assignments that have arrived, only waiting on one
+            if nothing is queued */
+            while(!done) {
+                if(queued == 0) {
+                    since = MPI_Wtime();
+                    MPI_Wait(&assign_req, &status);
+                    trace_event(trace, TRACE_WAIT, since, -1, 0, 0);
+                    flag = 1;
+                } else
+                    MPI_Test(&assign_req, &flag, &status);
 
-            /** Check if being called to terminate */
-            if(status.MPI_TAG == 0xFFFF) {
+                if(!flag)
+                    break;
+
+                /** Check if being called to terminate */
+                if(status.MPI_TAG == 0xFFFF) {
+                    done = 1;
+                    break;
+                }
+
+                MPI_Get_count(&status, MPI_INT, &count);
+
+                for(i = 0; i < count; i += TILE_INTS) {
+                    queue[(head + queued) % depth].frame = batch[i];
+                    queue[(head + queued) % depth].first = batch[i + 1];
+                    queue[(head + queued) % depth].y = batch[i + 2];
+                    queue[(head + queued) % depth].x = batch[i + 3];
+                    queue[(head + queued) % depth].h = batch[i + 4];
+                    queue[(head + queued++) % depth].w = batch[i + 5];
+                }
+
+                MPI_Irecv(batch, depth * TILE_INTS, MPI_INT, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &assign_req);
+            }
+
+            if(queued == 0) {
                 printf("Proc: %d \tJob: Exiting\n", rankID);
                 break;
             }
 
-            CUR_CHUNK = pixel_YX[2];
+            tile = queue[head];
+            head = (head + 1) % depth;
+            queued--;
 
 #ifdef DEBUG
-            printf("Proc: %d \tChunk %d \tJob: Algorithm\n", rankID, CUR_CHUNK);
+            printf("Proc: %d \tChunk %d \tJob: Algorithm\n", rankID, tile.first);
 #endif
 
-            /** For each Y value */
-            for(i = 0; i < CHUNK_WIDTH; i++) {
-                for(j = 0; j < CHUNK_WIDTH; j++) {
-                    image_arr[(i * CHUNK_WIDTH) + j] = iterator(
-                                                           c,
-                                                           -(((pixel_YX[0] + i) - (FULL_WIDTH / 2)) / (double) FULL_WIDTH) * 2,
-                                                           (((pixel_YX[1] + j) - (FULL_WIDTH / 2)) / (double) FULL_WIDTH) * 2
-                                                       );
-                }
-            }
+            /** Iterate over equation for each pixel in tile, or solve it by subdivision */
+            since = MPI_Wtime();
+            before = work_iterations(job.work, nthreads);
+            job.plane = &sweep.planes[tile.frame];
+            job.tile = tile;
+            job.stride = tile.w;
+            job.bands = nthreads == 1 ? 1 : (4 * nthreads < tile.h ? 4 * nthreads : tile.h);
+            sched_run(pool, job.bands, chunk_task, &job);
+            trace_event(trace, TRACE_COMPUTE, since, tile.first, work_iterations(job.work, nthreads) - before, 0);
+
+            /** Reuse the oldest result buffer once its send has gone */
+            since = MPI_Wtime();
+            MPI_Wait(&send_reqs[slot], MPI_STATUS_IGNORE);
+
+            /** Kept to be written later, the master only hears it is done */
+            if(mpiio)
+                store_tile(&store, &tile, counts_arr);
+            else
+                pixel_pack(counts_arr, tile.w, tile.h, tile.w,
+                           image_arr + (size_t) slot * sweep.max_pixels, tile.w);
 
 #ifdef DEBUG
-            printf("Proc: %d \tJob: Returning [# %d]\n", rankID, CUR_CHUNK);
+            printf("Proc: %d \tJob: Returning [# %d]\n", rankID, tile.first);
 #endif
 
-            /** Send portion of calculated imaged to MASTER */
-            MPI_Send(
-                image_arr,
-                CHUNK_WIDTH * CHUNK_WIDTH,
-                MPI_INT,
+            /** Send portion of calculated imaged to MASTER; results are
+            matched to their tiles by the order they arrive in */
+            MPI_Isend(
+                image_arr + (size_t) slot * sweep.max_pixels,
+                mpiio ? 0 : tile.h * tile.w,
+                PIXEL,
                 0,
-                CUR_CHUNK,
-                MPI_COMM_WORLD
+                TILE_TAG,
+                MPI_COMM_WORLD,
+                &send_reqs[slot]
             );
+
+            trace_event(trace, TRACE_SEND, since, tile.first, 0, mpiio ? 0 : tile.h * tile.w * sizeof(pixel_t));
+
+            slot = (slot + 1) % depth;
         }
+
+        MPI_Waitall(depth, send_reqs, MPI_STATUSES_IGNORE);
+
+        elapsed_time = MPI_Wtime() - start;
+        workers = nthreads;
+
+        free(send_reqs);
+        free(counts_arr);
+        free(queue);
+        free(batch);
+        sched_destroy(pool);
     }
 
     free(image_arr);
 
+    /** Everybody writes their own chunks straight into the image */
+    if(mpiio) {
+        start = MPI_Wtime();
+
+        ppm_tiles_types(&ppm, store.chunks, store.n, CHUNK_WIDTH, &memtype, &filetype);
+        ppm_write(&ppm, store.rgb, memtype, filetype);
+        ppm_close(&ppm);
+
+        write_time = MPI_Wtime() - start;
+        trace_event(trace, TRACE_WRITE, start, -1, 0, 0);
+
+        if(rankID == 0)
+            printf("\tImage written with MPI-IO in %f seconds.\n", write_time);
+
+        record.wall = elapsed_time + write_time;
+        sweep.io = write_time;
+
+        MPI_Type_free(&memtype);
+        MPI_Type_free(&filetype);
+        pthread_mutex_destroy(&store.lock);
+        free(store.chunks);
+        free(store.rgb);
+    }
+
+    for(i = 0; i < nthreads; i++)
+        skipped += job.skipped[i];
+
+    free(job.skipped);
+
+    /** Every rank's share of the work goes to the master */
+    if(bench_path) {
+        record.driver = "MS";
+        record.width = record.height = FULL_WIDTH;
+        record.frames = nframes;
+        record.chunk = CHUNK_WIDTH;
+        record.max_iterations = max_count - 1;
+        record.c = sweep.planes[0].c;
+        record.ranks = numProcs;
+        record.threads = nthreads;
+        record.compute = elapsed_time;
+        record.io = sweep.io;
+
+        if(bench_gather(&record, bench_path, MPI_COMM_WORLD, job.work, workers, nthreads, elapsed_time) != 0)
+            printf("Could not write benchmark record to %s\n", bench_path);
+    }
+
+    free(job.work);
+
+    /** Where every rank's time went */
+    if(trace_finish(trace, nthreads + 2, trace_names, trace_path, MPI_COMM_WORLD) != 0)
+        printf("Could not write trace to %s\n", trace_path);
+
+    free(trace_names);
+
+    /** Pixels filled by subdivision rather than iterated */
+    if(subdivide) {
+        MPI_Reduce(&skipped, &total_skipped, 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+        if(rankID == 0)
+            printf("\t%ld of %d pixels filled by subdivision\n", total_skipped, FULL_WIDTH * FULL_WIDTH);
+    }
+
+    /** Pixels moved back to the start of a reference orbit */
+    if(deep > 0) {
+        for(i = 0; i < nframes; i++)
+            if(sweep.planes[i].orbit) {
+                rebases += orbits[i].rebases;
+                zoom_release(&orbits[i]);
+            }
+
+        MPI_Reduce(&rebases, &total_rebases, 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+        if(rankID == 0)
+            printf("\t%ld rebases onto the reference orbits\n", total_rebases);
+    }
+
+    free(orbits);
+    free(sweep.planes);
+    pthread_mutex_destroy(&sweep.lock);
+    pthread_cond_destroy(&sweep.cond);
+
     /** Finalise MPI environment */
-    MPI_Type_free(&CHUNKxCHUNK_RE);
+    MPI_Type_free(&PIXEL);
+    palette_release();
     MPI_Finalize();
     fflush(stdout);
 
@@ -271,50 +1060,516 @@ int main(int argc, char* argv[])
 }
 
 /**
-Main iterating function of the program
+Block computing function
+*/
+long chunk_compute(const Plane* plane, int subdivide, int y, int x, int h, int w, int* out, int stride, BenchWork* work)
+{
+    long skipped = 0;
+    int i, j;
+    double since = bench_now();
+
+    if(subdivide)
+        skipped = tile_solve(plane, y, x, h, w, out, stride);
+    else
+        kernel_tile(plane, y, x, h, w, out, stride);
+
+    bench_add(work, since, out, h, w, stride);
+
+    /** Report iterations + 1 */
+    for(i = 0; i < h; i++)
+        for(j = 0; j < w; j++)
+            out[i * stride + j]++;
+
+    return skipped;
+}
+
+/**
+Cache lookup function
+*/
+int tile_lookup(Sweep* sweep, const Tile* tile, int* buf)
+{
+    Frame* image = &sweep->images[tile->frame % 2];
+    CacheKey key;
+    int i, j, k;
+
+    if(sweep->cache == NULL)
+        return 0;
+
+    /** Cached chunk by chunk, whatever tiles they were computed in */
+    for(i = 0; i < tile->h; i += CHUNK_WIDTH)
+        for(j = 0; j < tile->w; j += CHUNK_WIDTH) {
+            cache_key(&key, &sweep->planes[tile->frame], tile->y + i, tile->x + j,
+                      CHUNK_WIDTH, CHUNK_WIDTH, sweep->subdivide);
+
+            if(!cache_load(sweep->cache, &key, buf + i * tile->w + j, tile->w))
+                return 0;
+        }
+
+    /** Report iterations + 1 */
+    for(k = 0; k < tile->h * tile->w; k++)
+        buf[k]++;
+
+    pixel_pack(buf, tile->w, tile->h, tile->w, (pixel_t*) frame_at(image, tile->y, tile->x), image->pitch);
+    sweep_done(sweep, tile);
+
+    return 1;
+}
+
+/**
+Cache storing function
+*/
+void tile_keep(Sweep* sweep, const Tile* tile, int* counts)
+{
+    CacheKey key;
+    int i, j, k;
+
+    /** The cache holds plain iteration counts */
+    for(k = 0; k < tile->h * tile->w; k++)
+        counts[k]--;
+
+    for(i = 0; i < tile->h; i += CHUNK_WIDTH)
+        for(j = 0; j < tile->w; j += CHUNK_WIDTH) {
+            cache_key(&key, &sweep->planes[tile->frame], tile->y + i, tile->x + j,
+                      CHUNK_WIDTH, CHUNK_WIDTH, sweep->subdivide);
+            cache_store(sweep->cache, &key, counts + i * tile->w + j, tile->w);
+        }
+}
+
+/**
+Tile storing function
+*/
+void store_tile(ChunkStore* store, const Tile* tile, const int* counts)
+{
+    int i, j, k;
+    unsigned char* rgb;
+
+    pthread_mutex_lock(&store->lock);
+
+    /** One chunk at a time, as MPI-IO writes them */
+    for(i = 0; i < tile->h; i += CHUNK_WIDTH)
+        for(j = 0; j < tile->w; j += CHUNK_WIDTH) {
+            if(store->n == store->cap) {
+                store->cap *= 2;
+                store->chunks = (int *)realloc(store->chunks, store->cap * sizeof(int));
+                store->rgb = (unsigned char *)realloc(store->rgb, (size_t) store->cap * 3 * CHUNK_WIDTH * CHUNK_WIDTH);
+            }
+
+            rgb = store->rgb + (size_t) store->n * 3 * CHUNK_WIDTH * CHUNK_WIDTH;
+
+            for(k = 0; k < CHUNK_WIDTH; k++)
+                palette_row(counts + (i + k) * tile->w + j, rgb + k * 3 * CHUNK_WIDTH, CHUNK_WIDTH);
+
+            store->chunks[store->n++] = (tile->y + i) / CHUNK_WIDTH * (FULL_WIDTH / CHUNK_WIDTH) + (tile->x + j) / CHUNK_WIDTH;
+        }
+
+    pthread_mutex_unlock(&store->lock);
+}
+
+/**
+Tile band task
+*/
+void chunk_task(void* arg, int task, int thread)
+{
+    ChunkJob* job = (ChunkJob*) arg;
+    int row = task * job->tile.h / job->bands;
+    int rows = (task + 1) * job->tile.h / job->bands - row;
+
+    job->skipped[thread] += chunk_compute(
+                                job->plane,
+                                job->subdivide,
+                                job->tile.y + row,
+                                job->tile.x,
+                                rows,
+                                job->tile.w,
+                                job->out + row * job->stride,
+                                job->stride,
+                                &job->work[thread]
+                            );
+}
+
+/**
+Master compute thread
 */
-long iterator(Complex c, double im, double re)
+void* master_compute(void* arg)
 {
-    Complex z;
-    long itCount = 0;
+    MasterThread* self = (MasterThread*) arg;
+    ChunkJob* job = self->job;
+    Sweep* sweep = job->sweep;
+    Frame* image;
+    Tile tile;
+    int* buf = (int *)malloc(sweep->max_pixels * sizeof(int));
+    BenchWork* work = &job->work[self->thread];
+    long long before;
+    double since;
 
-    z.re = re;
-    z.im = im;
+    while(sweep_claim(sweep, 1, &tile) != SWEEP_DONE) {
+        if(tile_lookup(sweep, &tile, buf))
+            continue;
 
-    for(; itCount < MAX_ITER; itCount++) {
-        z = cmplx_add(cmplx_squared(z), c);
+        image = &sweep->images[tile.frame % 2];
+        since = MPI_Wtime();
+        before = work->iterations;
 
-        if(cmplx_magnitude(z) > 4)
+        job->skipped[self->thread] += chunk_compute(
+                                          &sweep->planes[tile.frame],
+                                          job->subdivide,
+                                          tile.y,
+                                          tile.x,
+                                          tile.h,
+                                          tile.w,
+                                          buf,
+                                          tile.w,
+                                          work
+                                      );
+
+        if(job->store)
+            store_tile(job->store, &tile, buf);
+        else
+            pixel_pack(buf, tile.w, tile.h, tile.w, (pixel_t*) frame_at(image, tile.y, tile.x), image->pitch);
+
+        trace_event(&job->trace[self->thread], TRACE_COMPUTE, since, tile.first, work->iterations - before, 0);
+
+        if(sweep->cache)
+            tile_keep(sweep, &tile, buf);
+
+        sweep_done(sweep, &tile);
+    }
+
+    free(buf);
+
+    return NULL;
+}
+
+/**
+Tile assigning function
+*/
+int assign_tiles(Dispatch* dispatch, int dest, int n)
+{
+    int client = dest - 1, count = 0, slot, claimed = 0;
+    int* batch = dispatch->assigned + client * dispatch->depth * TILE_INTS;
+    Sweep* sweep = dispatch->sweep;
+    Frame* image;
+    Tile tile;
+    MPI_Datatype placed;
+    MPI_Request* recv_reqs = dispatch->recv_reqs + client * dispatch->depth;
+    double since = MPI_Wtime();
+
+    /** Previous batch must be out before its buffer is refilled */
+    MPI_Wait(&dispatch->assign_reqs[client], MPI_STATUS_IGNORE);
+
+    for(slot = 0; slot < dispatch->depth && count < n; slot++) {
+        if(recv_reqs[slot] != MPI_REQUEST_NULL)
+            continue;
+
+        /** Nothing left, or the next frame has no image yet; tiles the
+        cache holds never go out */
+        while((claimed = sweep_claim(sweep, 0, &tile)) == 0 && tile_lookup(sweep, &tile, dispatch->counts))
+            ;
+
+        if(claimed != 0)
             break;
+
+        image = &sweep->images[tile.frame % 2];
+
+        /** Without an image to place it in, the result is only a notice the
+        tile is done. The type placing it can go as soon as the receive is
+        posted */
+        if(image->data) {
+            MPI_Type_vector(tile.h, tile.w, image->pitch, dispatch->pixel, &placed);
+            MPI_Type_commit(&placed);
+        } else
+            placed = dispatch->pixel;
+
+        MPI_Irecv(
+            image->data ? frame_at(image, tile.y, tile.x) : NULL,
+            image->data ? 1 : 0,
+            placed,
+            dest,
+            TILE_TAG,
+            MPI_COMM_WORLD,
+            &recv_reqs[slot]
+        );
+
+        if(image->data)
+            MPI_Type_free(&placed);
+
+        dispatch->tiles[client * dispatch->depth + slot] = tile;
+        batch[count * TILE_INTS] = tile.frame;
+        batch[count * TILE_INTS + 1] = tile.first;
+        batch[count * TILE_INTS + 2] = tile.y;
+        batch[count * TILE_INTS + 3] = tile.x;
+        batch[count * TILE_INTS + 4] = tile.h;
+        batch[count * TILE_INTS + 5] = tile.w;
+        count++;
     }
 
-    return itCount + 1;
+    if(count > 0)
+        MPI_Isend(
+            batch,
+            count * TILE_INTS,
+            MPI_INT,
+            dest,
+            0,
+            MPI_COMM_WORLD,
+            &dispatch->assign_reqs[client]
+        );
+
+    /** Nothing left, terminate client once its queue is done */
+    if(claimed == SWEEP_DONE) {
+        MPI_Send(
+            0,
+            0,
+            MPI_INT,
+            dest,
+            0xFFFF,
+            MPI_COMM_WORLD
+        );
+
+        dispatch->terminated[client] = 1;
+        dispatch->alive--;
+    }
+
+    dispatch->outstanding[client] += count;
+    trace_event(dispatch->trace, TRACE_SEND, since, -1, 0, count * TILE_INTS * sizeof(int));
+
+    return count;
 }
 
 /**
-Function which calculates the pixel values from the square array
+Frames file reading function
 */
-void plot(int* image_arr, FILE* img)
+int sweep_read(const char* path, const double* defaults, double** params)
 {
-    int i, j;
-    unsigned char line[3 * FULL_WIDTH];
-
-    for(i = 0; i < FULL_WIDTH; i++) {
-        for(j = 0; j < FULL_WIDTH; j++) {
-            if (*(image_arr + j + (i * FULL_WIDTH)) <= 63) {
-                line[3 * j] = 255;
-                line[3 * j + 1] = line[3 * j + 2] =
-                                      255 - 4 * *(image_arr + j + (i * FULL_WIDTH));
-            } else {
-                line[3 * j] = 255;
-                line[3 * j + 1] = *(image_arr + j + (i * FULL_WIDTH)) - 63;
-                line[3 * j + 2] = 0;
+    FILE* file = fopen(path, "r");
+    char line[512];
+    char *p, *end;
+    double* frame;
+    DDouble value;
+    int n = 0, cap = 16, got;
+
+    if(file == NULL)
+        return -1;
+
+    *params = (double *)malloc(cap * SWEEP_PARAMS * sizeof(double));
+
+    while(fgets(line, sizeof(line), file)) {
+        if(n == cap) {
+            cap *= 2;
+            *params = (double *)realloc(*params, cap * SWEEP_PARAMS * sizeof(double));
+        }
+
+        /** Defaults for whatever the line leaves out */
+        frame = *params + n * SWEEP_PARAMS;
+        memcpy(frame, defaults, SWEEP_PARAMS * sizeof(double));
+
+        /** Read to double-double, only the centre keeps the low part */
+        for(p = line, got = 0; got < 6; got++, p = end) {
+            value = dd_parse(p, &end);
+
+            if(end == p)
+                break;
+
+            frame[got] = value.hi;
+
+            if(got == 3 || got == 4)
+                frame[got + 3] = value.lo;
+        }
+
+        /** Blank or comment */
+        if(got <= 0 && (line[strspn(line, " \t\r\n")] == '\0' || line[strspn(line, " \t")] == '#'))
+            continue;
+
+        if((got != 2 && got != 3 && got != 6) || frame[2] < 1 || frame[5] <= 0) {
+            fclose(file);
+            free(*params);
+            return -1;
+        }
+
+        n++;
+    }
+
+    fclose(file);
+
+    return n;
+}
+
+/**
+Tile claiming function
+*/
+int sweep_claim(Sweep* sweep, int wait, Tile* tile)
+{
+    int per_row = FULL_WIDTH / CHUNK_WIDTH;
+    int left, chunk, col, k, result = 0;
+
+    pthread_mutex_lock(&sweep->lock);
+
+    while(1) {
+        if(sweep->next_chunk >= sweep->nframes * sweep->num_chunks)
+            result = SWEEP_DONE;
+        else if(sweep->next_chunk / sweep->num_chunks >= sweep->written + 2) {
+            if(wait) {
+                pthread_cond_wait(&sweep->cond, &sweep->lock);
+                continue;
             }
 
-            if (*(image_arr + j + (i * FULL_WIDTH)) == 320)
-                line[3 * j] = line[3 * j + 1] = line[3 * j + 2] = 255;
+            result = SWEEP_WAIT;
+        }
+
+        break;
+    }
+
+    if(result != 0) {
+        pthread_mutex_unlock(&sweep->lock);
+        return result;
+    }
+
+    left = sweep->nframes * sweep->num_chunks - sweep->next_chunk;
+
+    if(sweep->policy == SWEEP_GUIDED)
+        k = (left + sweep->workers - 1) / sweep->workers;
+    else if(sweep->policy == SWEEP_FACTORING) {
+        /** A new batch once every worker has had a tile of the last one */
+        if(sweep->batch_left == 0) {
+            sweep->batch = (left + 2 * sweep->workers - 1) / (2 * sweep->workers);
+            sweep->batch_left = sweep->workers;
+        }
+
+        k = sweep->batch;
+        sweep->batch_left--;
+    } else
+        k = 1;
+
+    /** Never past the end of the frame, and a rectangle: whole rows of
+    chunks from the start of a row, otherwise the rest of the row at most */
+    chunk = sweep->next_chunk % sweep->num_chunks;
+    col = chunk % per_row;
+
+    if(k > sweep->num_chunks - chunk)
+        k = sweep->num_chunks - chunk;
+
+    if(k < 1)
+        k = 1;
+
+    tile->frame = sweep->next_chunk / sweep->num_chunks;
+    tile->first = sweep->next_chunk;
+    chunk_origin(chunk, &tile->y, &tile->x);
+
+    if(col == 0 && k >= per_row) {
+        k /= per_row;
+        k = k < SWEEP_MAX_ROWS ? k : SWEEP_MAX_ROWS;
+        tile->h = k * CHUNK_WIDTH;
+        tile->w = FULL_WIDTH;
+        k *= per_row;
+    } else {
+        k = k < per_row - col ? k : per_row - col;
+        tile->h = CHUNK_WIDTH;
+        tile->w = k * CHUNK_WIDTH;
+    }
+
+    sweep->next_chunk += k;
+    sweep->tiles++;
+
+    pthread_mutex_unlock(&sweep->lock);
+
+    return 0;
+}
+
+/**
+Claim waiting function
+*/
+void sweep_wait(Sweep* sweep)
+{
+    pthread_mutex_lock(&sweep->lock);
+
+    while(sweep->next_chunk < sweep->nframes * sweep->num_chunks &&
+          sweep->next_chunk / sweep->num_chunks >= sweep->written + 2)
+        pthread_cond_wait(&sweep->cond, &sweep->lock);
+
+    pthread_mutex_unlock(&sweep->lock);
+}
+
+/**
+Tile completion function
+*/
+void sweep_done(Sweep* sweep, const Tile* tile)
+{
+    int slot = tile->frame % 2;
+
+    pthread_mutex_lock(&sweep->lock);
+
+    sweep->done[slot] += (tile->h / CHUNK_WIDTH) * (tile->w / CHUNK_WIDTH);
+
+    if(sweep->done[slot] == sweep->num_chunks)
+        pthread_cond_broadcast(&sweep->cond);
+
+    pthread_mutex_unlock(&sweep->lock);
+}
+
+/**
+Frame writing thread
+*/
+void* sweep_writer(void* arg)
+{
+    Sweep* sweep = (Sweep*) arg;
+    SchedPool* pool = sched_create(sweep->nthreads);
+    Frame* image;
+    FILE* img;
+    char name[64];
+    int f, slot, *column = NULL;
+    double since;
+
+    if(sweep->rows < FULL_WIDTH)
+        column = (int *)malloc((FULL_WIDTH - sweep->rows) * sizeof(int));
+
+    for(f = 0; f < sweep->nframes; f++) {
+        slot = f % 2;
+        image = &sweep->images[slot];
+
+        pthread_mutex_lock(&sweep->lock);
+
+        while(sweep->done[slot] < sweep->num_chunks)
+            pthread_cond_wait(&sweep->cond, &sweep->lock);
+
+        pthread_mutex_unlock(&sweep->lock);
+
+        since = MPI_Wtime();
+
+        /** Bottom rows mirror the top ones, bar column 0 which has no mirror */
+        if(column) {
+            chunk_compute(&sweep->planes[f], 0, sweep->rows, 0, FULL_WIDTH - sweep->rows, 1, column, 1, NULL);
+            pixel_pack(column, 1, FULL_WIDTH - sweep->rows, 1, (pixel_t*) frame_at(image, sweep->rows, 0), image->pitch);
+            frame_mirror(image, sweep->rows);
         }
 
-        fwrite(line, 1, 3 * FULL_WIDTH, img);
+#ifdef DEBUG
+        printf("Proc: Ma\tJob: Plotting frame %d\n", f);
+#endif
+
+        /** Coloured on all of the master's threads */
+        snprintf(name, sizeof(name), sweep->pattern, f);
+        img = fopen(name, "w");
+
+        if(img == NULL)
+            printf("Could not open handle to %s\n", name);
+        else {
+            fprintf(img, "P6\n%d %d 255\n", FULL_WIDTH, FULL_WIDTH);
+            palette_frame(image, img, pool);
+            fclose(img);
+        }
+
+        sweep->io += MPI_Wtime() - since;
+        trace_event(sweep->trace, TRACE_WRITE, since, f, 0, 0);
+
+        /** Image free for frame f + 2 */
+        pthread_mutex_lock(&sweep->lock);
+        sweep->done[slot] = 0;
+        sweep->written++;
+        pthread_cond_broadcast(&sweep->cond);
+        pthread_mutex_unlock(&sweep->lock);
     }
+
+    free(column);
+    sched_destroy(pool);
+
+    return NULL;
 }